@@ -1,4 +1,4 @@
-QT     += core gui widgets sql network
+QT     += core gui widgets sql network concurrent
 CONFIG += c++17
 
 # The following define makes your compiler emit warnings if you use
@@ -16,24 +16,47 @@ INCLUDEPATH += src/
 
 SOURCES += \
     src/data/DataStore.cpp \
+    src/data/DirWalker.cpp \
+    src/data/EhBackupReader.cpp \
+    src/data/ImageHash.cpp \
+    src/data/LibraryWatcher.cpp \
+    src/data/PostingList.cpp \
+    src/data/SearchIndex.cpp \
+    src/data/SearchService.cpp \
+    src/data/SearchTerm.cpp \
     src/widget/AspectRatioLabel.cpp \
     src/data/DataImporter.cpp \
     src/data/EhentaiApi.cpp \
+    src/DuplicateClusterer.cpp \
     src/FuzzSearcher.cpp \
     src/ui/MainWindow.cpp \
     src/ui/SettingsDialog.cpp \
     src/main.cpp \
+    src/widget/SearchResultModel.cpp \
     src/widget/TabbedSearchResult.cpp
 
 HEADERS += \
+    src/data/BoundedQueue.h \
     src/data/DataStore.h \
     src/data/DatabaseSchema.h \
+    src/data/DirWalker.h \
+    src/data/EhBackupReader.h \
+    src/data/ImageHash.h \
+    src/data/LibraryWatcher.h \
+    src/data/ParallelFilter.h \
+    src/data/PostingList.h \
+    src/data/SchemaCodec.h \
+    src/data/SearchIndex.h \
+    src/data/SearchService.h \
+    src/data/SearchTerm.h \
     src/widget/AspectRatioLabel.h \
     src/data/DataImporter.h \
     src/data/EhentaiApi.h \
+    src/DuplicateClusterer.h \
     src/FuzzSearcher.h \
     src/ui/MainWindow.h \
     src/ui/SettingsDialog.h \
+    src/widget/SearchResultModel.h \
     src/widget/TabbedSearchResult.h
 
 FORMS += \
@@ -0,0 +1,657 @@
+#include "Benchmark.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QRegExp>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtSql>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+
+#include "DuplicateClusterer.h"
+#include "FuzzSearcher.h"
+#include "data/DataImporter.h"
+#include "data/DataStore.h"
+#include "data/DirWalker.h"
+#include "data/SearchIndex.h"
+#include "data/SearchTerm.h"
+
+namespace {
+// Insert folders [begin, end) with a few tags each, `batch_size` per transaction,
+// through DataStore::DbTransaction() on the connection `conn_name`, so the search
+// index picks them up like it does for an import.
+bool InsertFolders(const QString &conn_name, int begin, int end, int batch_size) {
+    const QStringList namespaces = {"artist", "parody", "female"};
+    for (int batch_begin = begin; batch_begin < end; batch_begin += batch_size) {
+        int batch_end = std::min(end, batch_begin + batch_size);
+        bool ok = false;
+        auto err = DataStore::DbTransaction(
+            [&](QSqlDatabase *db) {
+                QSqlQuery folder_query{*db};
+                QSqlQuery tag_query{*db};
+                if (!folder_query.prepare("INSERT INTO img_folders(folder_path, title, "
+                                          "record_time, eh_gid) VALUES (?, ?, ?, '')") ||
+                    !tag_query.prepare("INSERT INTO folder_tags(fid, namespace, stem) "
+                                       "VALUES (?, ?, ?)")) {
+                    qCritical() << folder_query.lastError() << tag_query.lastError();
+                    return false;
+                }
+                std::vector<int64_t> fids;
+                for (int i = batch_begin; i < batch_end; i++) {
+                    folder_query.addBindValue(QString("/benchmark/folder_%1").arg(i));
+                    folder_query.addBindValue(
+                        QString("[Circle %1] Benchmark Title %2 (Original)")
+                            .arg(i % 997)
+                            .arg(i));
+                    folder_query.addBindValue(qlonglong(1600000000) + i);
+                    if (!folder_query.exec()) {
+                        qCritical() << folder_query.lastError();
+                        return false;
+                    }
+                    qlonglong fid = folder_query.lastInsertId().toLongLong();
+                    fids.push_back(fid);
+                    for (const QString &ns : namespaces) {
+                        tag_query.addBindValue(fid);
+                        tag_query.addBindValue(ns);
+                        tag_query.addBindValue(QString("tag %1").arg(i % 331));
+                        if (!tag_query.exec()) {
+                            qCritical() << tag_query.lastError();
+                            return false;
+                        }
+                    }
+                }
+                ok = DataStore::DbRefreshSearchDocsReqTransaction(*db, fids);
+                return ok;
+            },
+            conn_name);
+        if (err) {
+            qCritical() << *err;
+            return false;
+        }
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+// Run DataStore::DbSearch() on a fresh read-only connection until *stop is set or
+// max_queries are done, each in its own read transaction like SearchService does.
+// Returns the latency of each query in ms.
+std::vector<double> MeasureQueries(const QString &db_path, const QString &conn_name,
+                                   const std::atomic<bool> *stop, int max_queries) {
+    std::vector<double> ret;
+    {
+        auto db = DataStore::OpenDatabase(db_path, conn_name);
+        if (!db || !DataStore::ConfigureConnection(*db, true))
+            return ret;
+        QElapsedTimer timer;
+        for (int i = 0; i < max_queries && !(stop && stop->load()); i++) {
+            timer.start();
+            if (!db->transaction()) {
+                qCritical() << db->lastError();
+                break;
+            }
+            auto result =
+                DataStore::DbSearch(*db, {QString("tag %1").arg(i % 331)}, {});
+            db->rollback();
+            if (!result)
+                break;
+            ret.push_back(timer.nsecsElapsed() / 1e6);
+        }
+    }
+    QSqlDatabase::removeDatabase(conn_name);
+    return ret;
+}
+
+// the import path before reduced resolution decoding: full decode, then scale
+QByteArray FullDecodeThumbnail(const QString &file_path) {
+    QImage image(file_path);
+    if (image.isNull())
+        return {};
+    if (image.width() > image.height()) {
+        image = image.scaled(320, 200, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    } else {
+        image = image.scaled(200, 320, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return DataImporter::EncodeThumbnail(image);
+}
+
+// the scan before DirWalker, returns the number of folders listed
+int64_t EntryInfoListScan(const QDir &dir, int64_t *image_folders) {
+    int64_t listed = 1;
+    bool has_image = false;
+    const auto infos = dir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries);
+    for (const QFileInfo &info : infos) {
+        if (info.isFile()) {
+            auto ext = info.suffix().toLower();
+            if (ext == "jpg" || ext == "png" || ext == "jpeg")
+                has_image = true;
+        } else if (info.isDir()) {
+            listed += EntryInfoListScan({info.absoluteFilePath()}, image_folders);
+        }
+    }
+    if (has_image)
+        (*image_folders)++;
+    return listed;
+}
+
+// rows of folders [begin, end), like an EhViewer backup import writes them
+void MakeFolderRows(int begin, int end, std::vector<schema::ImageFolders> *folders,
+                    std::vector<schema::CoverImages> *covers,
+                    std::vector<schema::EhentaiMetadata> *metadata) {
+    // about the size of a thumbnail
+    static const QByteArray cover(12 * 1024, 'x');
+    for (int i = begin; i < end; i++) {
+        folders->push_back({
+            .fid = i + 1,
+            .folder_path = QString("/benchmark/folder_%1").arg(i),
+            .title =
+                QString("[Circle %1] Benchmark Title %2 (Original)").arg(i % 997).arg(i),
+            .record_time = 1600000000 + i,
+            .eh_gid = QString::number(i + 1),
+        });
+        covers->push_back({.fid = i + 1, .cover_fname = "001.jpg", .cover = cover});
+        metadata->push_back({
+            .gid = QString::number(i + 1),
+            .token = "0123456789",
+            .title = folders->back().title,
+            .title_jpn = "",
+            .category = EhCategory::DOUJINSHI,
+            .thumb = "",
+            .uploader = "benchmark",
+            .posted = 1600000000 + i,
+            .filecount = 24,
+            .filesize = 1 << 24,
+            .expunged = 0,
+            .rating = 4.5,
+            .meta_updated = 0,
+        });
+    }
+}
+
+// `count` keywords shaped like the titles and tags of a library, ~1 in 4 is a title
+std::vector<QString> MakeKeywords(int count) {
+    const QStringList namespaces = {"artist", "parody", "female", "male", "language"};
+    std::vector<QString> ret;
+    ret.reserve(count);
+    for (int i = 0; i < count; i++) {
+        if (i % 4 == 0) {
+            ret.push_back(QString("[Circle %1] Benchmark Title %2 (Original)")
+                              .arg(i % 997)
+                              .arg(i));
+        } else {
+            const QString &ns = namespaces[i % namespaces.size()];
+            ret.push_back(QString("%1:Tag %2").arg(ns).arg(i % 3331));
+        }
+    }
+    return ret;
+}
+
+// VmHWM in KiB, -1 if unknown (not linux)
+int64_t PeakRssKb() {
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+    const QList<QByteArray> lines = status.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("VmHWM:"))
+            return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+    }
+    return -1;
+}
+
+// start measuring VmHWM from the current RSS
+void ResetPeakRss() {
+    QFile clear_refs("/proc/self/clear_refs");
+    if (clear_refs.open(QIODevice::WriteOnly))
+        clear_refs.write("5");
+}
+
+// Time of the joins the secondary indexes are for: every search document, and the tags
+// and metadata of one gallery.
+qint64 TimeJoinQueries(QSqlDatabase &db) {
+    QElapsedTimer timer;
+    timer.start();
+    QSqlQuery query{db};
+    query.setForwardOnly(true);
+    if (query.exec(schema::SearchDocs::SelectSql(""))) {
+        while (query.next()) {
+        }
+    }
+    if (query.exec("SELECT eh_gid FROM img_folders WHERE eh_gid != '' LIMIT 1") &&
+        query.next()) {
+        DataStore::DbQueryEhTagsByGid(db, query.value(0).toString());
+        DataStore::DbQueryEhMetaByGid(db, query.value(0).toString());
+    }
+    return timer.elapsed();
+}
+} // namespace
+
+QString Benchmark::FormatLatencies(std::vector<double> latencies_ms) {
+    if (latencies_ms.empty())
+        return "no data";
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    auto percentile = [&latencies_ms](double p) {
+        size_t i = std::min(latencies_ms.size() - 1, size_t(p * latencies_ms.size()));
+        return latencies_ms[i];
+    };
+    return QString("p50 %1 / p99 %2 / max %3 ms (%4 queries)")
+        .arg(percentile(0.5), 0, 'f', 2)
+        .arg(percentile(0.99), 0, 'f', 2)
+        .arg(latencies_ms.back(), 0, 'f', 2)
+        .arg(latencies_ms.size());
+}
+
+QString Benchmark::SearchDuringImport(int seed_count, int import_count) {
+    QTemporaryDir dir;
+    if (!dir.isValid())
+        return "Failed to create a temporary directory";
+    // Pooled connection names: in the benchmark process the scratch db stands in for
+    // the library, and the search index follows the writes made through them.
+    const QString writer_name = "db-conn-benchmark-writer";
+    const QString reader_name = "db-conn-benchmark-reader";
+
+    QStringList report;
+    report << QString("DbSearch() latency, %1 folders present, %2 imported")
+                  .arg(seed_count)
+                  .arg(import_count);
+    for (const QString journal_mode : {"DELETE", "WAL"}) {
+        QString db_path = dir.filePath(journal_mode + ".db");
+        QString line;
+        {
+            auto db = DataStore::OpenDatabase(db_path, writer_name);
+            if (!db || !DataStore::ConfigureConnection(*db, false))
+                return "Failed to open " + db_path;
+            QSqlQuery query{*db};
+            if (!query.exec("PRAGMA journal_mode = " + journal_mode)) {
+                qCritical() << query.lastError();
+                return "Failed to set journal mode " + journal_mode;
+            }
+            query.finish();
+            if (!DataStore::DbCreateTables(*db) ||
+                !InsertFolders(writer_name, 0, seed_count, 1000) ||
+                !DataStore::GetSearchIndex().rebuild(*db))
+                return "Failed to prepare " + db_path;
+
+            auto idle = MeasureQueries(db_path, reader_name, nullptr, 200);
+
+            std::atomic<bool> stop{false};
+            QFuture<std::vector<double>> busy = QtConcurrent::run([&] {
+                return MeasureQueries(db_path, reader_name, &stop,
+                                      std::numeric_limits<int>::max());
+            });
+            QElapsedTimer timer;
+            timer.start();
+            // small batches, like an import committing as it goes
+            bool import_ok =
+                InsertFolders(writer_name, seed_count, seed_count + import_count, 200);
+            qint64 import_ms = timer.elapsed();
+            stop = true;
+            auto importing = busy.result();
+            if (!import_ok)
+                return "Failed to import into " + db_path;
+
+            line = QString("%1: idle %2; importing %3; import took %4 ms")
+                       .arg(journal_mode == "WAL" ? "WAL" : "Rollback journal",
+                            FormatLatencies(idle), FormatLatencies(importing))
+                       .arg(import_ms);
+        }
+        QSqlDatabase::removeDatabase(writer_name);
+        qInfo() << line;
+        report << line;
+    }
+    return report.join("\n");
+}
+
+QString Benchmark::Thumbnails(const QString &fixture_dir, int max_images) {
+    QStringList files;
+    QDirIterator it(fixture_dir, {"*.jpg", "*.jpeg", "*.png"}, QDir::Files,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext() && files.size() < max_images)
+        files << it.next();
+    if (files.isEmpty())
+        return "No jpg or png image found in " + fixture_dir;
+
+    QStringList report;
+    report << QString("Thumbnails of %1 images in %2").arg(files.size()).arg(fixture_dir);
+    auto measure = [&files](const QString &name,
+                            const std::function<QByteArray(const QString &)> &generate) {
+        ResetPeakRss();
+        int64_t rss_before = PeakRssKb();
+        int failed = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (const QString &file : files) {
+            if (generate(file).isEmpty())
+                failed++;
+        }
+        double seconds = timer.nsecsElapsed() / 1e9;
+        int64_t rss_peak = PeakRssKb();
+        QString line = QString("%1: %2 images/s, peak RSS %3 MiB (+%4 MiB), %5 failed")
+                           .arg(name)
+                           .arg(files.size() / seconds, 0, 'f', 1)
+                           .arg(rss_peak / 1024.0, 0, 'f', 1)
+                           .arg((rss_peak - rss_before) / 1024.0, 0, 'f', 1)
+                           .arg(failed);
+        if (rss_peak < 0)
+            line = QString("%1: %2 images/s, %3 failed")
+                       .arg(name)
+                       .arg(files.size() / seconds, 0, 'f', 1)
+                       .arg(failed);
+        qInfo() << line;
+        return line;
+    };
+    // the first pass also warms the page cache for the second
+    measure("Warm up", FullDecodeThumbnail);
+    report << measure("Full decode", FullDecodeThumbnail);
+    report << measure("Reduced decode", DataImporter::GenerateImgThumbnail);
+    return report.join("\n");
+}
+
+QString Benchmark::DirScan(const QString &root) {
+    QStringList report;
+    report << QString("Folders listed per second under %1").arg(root);
+    auto add_line = [&report](const QString &name, int64_t listed, int64_t image_folders,
+                              qint64 ms) {
+        QString line = QString("%1: %2 folders/s (%3 folders, %4 with images, %5 ms)")
+                           .arg(name)
+                           .arg(listed * 1000.0 / std::max<qint64>(ms, 1), 0, 'f', 0)
+                           .arg(listed)
+                           .arg(image_folders)
+                           .arg(ms);
+        qInfo() << line;
+        report << line;
+    };
+
+    QElapsedTimer timer;
+    // the first pass also warms the dentry cache for the others
+    for (const QString name : {"Warm up", "entryInfoList"}) {
+        int64_t image_folders = 0;
+        timer.start();
+        int64_t listed = EntryInfoListScan(QDir(root), &image_folders);
+        add_line(name, listed, image_folders, timer.elapsed());
+    }
+    const int cores = QThread::idealThreadCount();
+    for (int threads : {1, 4, std::max(8, cores * 2)}) {
+        for (bool stop_at_first_image : {false, true}) {
+            std::atomic<int64_t> image_folders{0};
+            DirWalker walker(threads);
+            walker.setStopAtFirstImage(stop_at_first_image);
+            timer.start();
+            walker.walk(root, [&image_folders](const DirWalker::ImageFolder &) {
+                image_folders++;
+                return true;
+            });
+            add_line(QString("DirWalker, %1 threads%2")
+                         .arg(threads)
+                         .arg(stop_at_first_image ? ", stop at first image" : ""),
+                     walker.dirsListed(), image_folders, timer.elapsed());
+        }
+    }
+    return report.join("\n");
+}
+
+QString Benchmark::BulkInsert(int row_count) {
+    QTemporaryDir dir;
+    if (!dir.isValid())
+        return "Failed to create a temporary directory";
+    // the batch size of the importers
+    constexpr int kBatchSize = 128;
+    const QString conn_name = "benchmark-insert";
+
+    QStringList report;
+    report << QString("%1 folders with cover and eh metadata, %2 per transaction")
+                  .arg(row_count)
+                  .arg(kBatchSize);
+    for (bool bulk : {false, true}) {
+        QString db_path = dir.filePath(bulk ? "bulk.db" : "per_row.db");
+        QString line;
+        {
+            auto db = DataStore::OpenDatabase(db_path, conn_name);
+            if (!db || !DataStore::ConfigureConnection(*db, false) ||
+                !DataStore::DbCreateTables(*db))
+                return "Failed to prepare " + db_path;
+
+            std::vector<schema::ImageFolders> folders;
+            std::vector<schema::CoverImages> covers;
+            std::vector<schema::EhentaiMetadata> metadata;
+            QElapsedTimer timer;
+            timer.start();
+            for (int begin = 0; begin < row_count; begin += kBatchSize) {
+                folders.clear();
+                covers.clear();
+                metadata.clear();
+                MakeFolderRows(begin, std::min(row_count, begin + kBatchSize), &folders,
+                               &covers, &metadata);
+                if (!db->transaction())
+                    return "Failed to start a transaction on " + db_path;
+                bool ok = true;
+                if (bulk) {
+                    ok = DataStore::DbBulkInsert(*db, folders) &&
+                         DataStore::DbBulkInsert(*db, covers) &&
+                         DataStore::DbBulkInsert(*db, metadata);
+                } else {
+                    for (size_t i = 0; ok && i < folders.size(); i++) {
+                        ok = DataStore::DbInsert(*db, folders[i]) &&
+                             DataStore::DbInsert(*db, covers[i]) &&
+                             DataStore::DbInsert(*db, metadata[i]);
+                    }
+                }
+                if (!ok || !db->commit()) {
+                    db->rollback();
+                    return "Failed to insert into " + db_path;
+                }
+            }
+            double seconds = timer.nsecsElapsed() / 1e9;
+            line = QString("%1: %2 folders/s (%3 ms)")
+                       .arg(bulk ? "DbBulkInsert" : "DbInsert per row")
+                       .arg(row_count / seconds, 0, 'f', 0)
+                       .arg(qint64(seconds * 1000));
+        }
+        QSqlDatabase::removeDatabase(conn_name);
+        qInfo() << line;
+        report << line;
+    }
+    return report.join("\n");
+}
+
+QString Benchmark::KeywordMatching(int keyword_count) {
+    const std::vector<QString> keywords = MakeKeywords(keyword_count);
+    std::vector<QString> folded_keywords;
+    folded_keywords.reserve(keywords.size());
+    for (const QString &kw : keywords)
+        folded_keywords.push_back(kw.toCaseFolded());
+
+    QStringList report;
+    report << QString("%1 keywords, case insensitive, ms per pass over all of them")
+                  .arg(keywords.size());
+    // the literals are answered by the fast path of SearchTerm
+    const QStringList terms = {"tag 1234", "benchmark title 99", "circle",
+                               "female:tag \\d+7$", "^\\[circle 4\\d\\]"};
+    for (const QString &term : terms) {
+        QElapsedTimer timer;
+        QRegExp qregexp{term, Qt::CaseInsensitive};
+        int qregexp_matches = 0;
+        timer.start();
+        for (const QString &kw : keywords)
+            qregexp_matches += qregexp.indexIn(kw) >= 0;
+        qint64 qregexp_ms = timer.elapsed();
+
+        QRegularExpression regex{term, QRegularExpression::CaseInsensitiveOption};
+        regex.optimize();
+        int regex_matches = 0;
+        timer.start();
+        for (const QString &kw : keywords)
+            regex_matches += regex.match(kw).hasMatch();
+        qint64 regex_ms = timer.elapsed();
+
+        auto search_term = SearchTerm::Compile(term);
+        if (!search_term)
+            return "Invalid term " + term;
+        int term_matches = 0;
+        timer.start();
+        for (const QString &kw : folded_keywords)
+            term_matches += search_term->matches(kw);
+        qint64 term_ms = timer.elapsed();
+
+        QString line = QString("\"%1\": QRegExp %2, QRegularExpression %3, "
+                               "SearchTerm%4 %5 (%6 matches)")
+                           .arg(term)
+                           .arg(qregexp_ms)
+                           .arg(regex_ms)
+                           .arg(search_term->isLiteral() ? " (literal)" : "")
+                           .arg(term_ms)
+                           .arg(term_matches);
+        if (qregexp_matches != term_matches || regex_matches != term_matches)
+            line += QString(", mismatch: %1 / %2 matches")
+                        .arg(qregexp_matches)
+                        .arg(regex_matches);
+        qInfo() << line;
+        report << line;
+    }
+    return report.join("\n");
+}
+
+QString Benchmark::LongestCommonSubstring(const QStringList &library_titles,
+                                          int title_count) {
+    // in the form title_norms keeps for FuzzSearcher::filterMatching()
+    auto prepare = [](const QString &title) {
+        return FuzzSearcher::NormalizeTitle(title);
+    };
+    QStringList titles;
+    for (const QString &title : library_titles.mid(0, title_count))
+        titles << prepare(title);
+    const int library_count = titles.size();
+    for (int i = 0; titles.size() < title_count; i++) {
+        titles << prepare(QString("[Circle %1] Benchmark Title %2 (Original)")
+                              .arg(i % 997)
+                              .arg(i));
+    }
+
+    QStringList report;
+    report << QString("%1 titles (%2 from the library), ms per pass over all of them")
+                  .arg(titles.size())
+                  .arg(library_count);
+    for (int i : {0, title_count / 3, title_count * 2 / 3}) {
+        const QString &stem = titles[i];
+        QElapsedTimer timer;
+        timer.start();
+        int64_t dp_total = 0;
+        for (const QString &title : qAsConst(titles))
+            dp_total += FuzzSearcher::Lcs(title, stem).size();
+        qint64 dp_ms = timer.elapsed();
+
+        timer.start();
+        const SubstringAutomaton automaton{stem};
+        int64_t automaton_total = 0;
+        for (const QString &title : qAsConst(titles))
+            automaton_total += automaton.longestCommonSubstring(title);
+        qint64 automaton_ms = timer.elapsed();
+
+        QString line = QString("stem of %1 chars: Lcs %2, SubstringAutomaton %3")
+                           .arg(stem.size())
+                           .arg(dp_ms)
+                           .arg(automaton_ms);
+        if (dp_total != automaton_total)
+            line += QString(", mismatch: total length %1 / %2")
+                        .arg(dp_total)
+                        .arg(automaton_total);
+        qInfo() << line;
+        report << line;
+    }
+    return report.join("\n");
+}
+
+QString Benchmark::DuplicateClustering(const QStringList &library_titles,
+                                       int title_count) {
+    QStringList titles = library_titles.mid(0, title_count);
+    const int library_count = titles.size();
+    for (int i = 0; titles.size() < title_count; i++) {
+        if (i % 10 == 9) {
+            // the same gallery downloaded again, under a slightly different name
+            titles << QString("(C%1) [Circle %2] Benchmark Title %3 [Digital]")
+                          .arg(90 + i % 10)
+                          .arg((i - 5) % 997)
+                          .arg(i - 5);
+        } else {
+            titles << QString("[Circle %1] Benchmark Title %2 (Original)")
+                          .arg(i % 997)
+                          .arg(i);
+        }
+    }
+    QStringList normalized;
+    normalized.reserve(titles.size());
+    for (const QString &title : qAsConst(titles))
+        normalized << FuzzSearcher::NormalizeTitle(title);
+
+    QElapsedTimer timer;
+    timer.start();
+    const auto clusters = DuplicateClusterer::Cluster(titles, normalized, nullptr);
+    const qint64 ms = timer.elapsed();
+    int64_t clustered = 0;
+    for (const std::vector<int> &cluster : clusters)
+        clustered += cluster.size();
+    QString report = QString("%1 titles (%2 from the library): %3 clusters of %4 titles "
+                             "in %5 ms")
+                         .arg(titles.size())
+                         .arg(library_count)
+                         .arg(clusters.size())
+                         .arg(clustered)
+                         .arg(ms);
+    qInfo() << report;
+    return report;
+}
+
+QString Benchmark::Migration() {
+    QTemporaryDir dir;
+    if (!dir.isValid())
+        return "Failed to create a temporary directory";
+    const QString library_path = DataStore::GetSqlitePath();
+    const QString db_path = dir.filePath("migration.db");
+    // the log of a WAL db may hold the last commits
+    if (!QFile::copy(library_path, db_path) ||
+        (QFile::exists(library_path + "-wal") &&
+         !QFile::copy(library_path + "-wal", db_path + "-wal")))
+        return "Failed to copy " + library_path;
+    const QString conn_name = "benchmark-migration";
+
+    QStringList report;
+    report << "Copy of " + library_path;
+    {
+        auto db = DataStore::OpenDatabase(db_path, conn_name);
+        if (!db || !DataStore::ConfigureConnection(*db, false))
+            return "Failed to open " + db_path;
+        qint64 before_ms = TimeJoinQueries(*db);
+        QStringList steps;
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = DataStore::DbCreateTables(
+            *db, [&steps](const QString &table_name, int64_t from, int64_t to) {
+                steps << QString("%1 %2 -> %3").arg(table_name).arg(from).arg(to);
+            });
+        qint64 migration_ms = timer.elapsed();
+        if (!ok)
+            return "Failed to migrate " + db_path;
+        report << (steps.isEmpty() ? "Already at the current revision"
+                                   : QString("Migrated %1 in %2 ms")
+                                         .arg(steps.join(", "))
+                                         .arg(migration_ms));
+        report << QString("Join queries: %1 ms before, %2 ms after")
+                      .arg(before_ms)
+                      .arg(TimeJoinQueries(*db));
+    }
+    QSqlDatabase::removeDatabase(conn_name);
+    for (const QString &line : qAsConst(report))
+        qInfo() << line;
+    return report.join("\n");
+}
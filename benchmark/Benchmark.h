@@ -0,0 +1,49 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+// Micro benchmarks of the data layer, run by the EhDbViewerBenchmark command line tool.
+// They work on scratch data in a temporary directory, never write the user's library.
+// Each one blocks until finished and returns a human readable report.
+class Benchmark {
+  public:
+    // Latency of DataStore::DbSearch() on a reader connection, idle and while another
+    // connection imports `import_count` folders. Once with the rollback journal and
+    // once with WAL.
+    static QString SearchDuringImport(int seed_count = 10000, int import_count = 20000);
+    // Thumbnails of up to `max_images` images under fixture_dir, through a full decode
+    // then scale (the old import path) and through DataImporter::GenerateImgThumbnail().
+    // Reports images per second and peak RSS of each.
+    static QString Thumbnails(const QString &fixture_dir, int max_images = 300);
+    // Folders listed per second when scanning root, with the old recursive
+    // QDir::entryInfoList() scan and with DirWalker.
+    static QString DirScan(const QString &root);
+    // Folders inserted per second with their cover and eh metadata, through a
+    // DataStore::DbInsert() per row and through DataStore::DbBulkInsert().
+    static QString BulkInsert(int row_count = 20000);
+    // Time to match search terms against a synthetic set of keywords, through QRegExp
+    // (the old matcher), an optimized QRegularExpression and SearchTerm.
+    static QString KeywordMatching(int keyword_count = 1000000);
+    // Time of the longest common substring of a few query stems and `title_count`
+    // titles, through FuzzSearcher::Lcs() and SubstringAutomaton. The titles are
+    // library_titles, completed with synthetic ones if there are not enough.
+    static QString LongestCommonSubstring(const QStringList &library_titles,
+                                          int title_count = 100000);
+    // Time of DuplicateClusterer::Cluster() over `title_count` titles: library_titles
+    // completed with synthetic ones, a tenth of them renamed copies of others.
+    static QString DuplicateClustering(const QStringList &library_titles,
+                                       int title_count = 100000);
+
+    // On a copy of the library's db: time of the joins the secondary indexes are for,
+    // of DataStore::DbCreateTables() and of the same joins again. Only shows a
+    // difference when the copy is at an older schema revision.
+    static QString Migration();
+
+    // "p50 1.23 / p99 4.56 / max 7.89 ms" of the given latencies in ms
+    static QString FormatLatencies(std::vector<double> latencies_ms);
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,36 @@
+QT     += core gui widgets sql network concurrent
+CONFIG += c++17 console
+CONFIG -= app_bundle
+TARGET = EhDbViewerBenchmark
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+# the sources include both "data/..." and "src/..."
+INCLUDEPATH += ../src/ ../
+
+SOURCES += \
+    Benchmark.cpp \
+    main.cpp \
+    ../src/data/DataImporter.cpp \
+    ../src/data/DataStore.cpp \
+    ../src/data/DirWalker.cpp \
+    ../src/data/EhBackupReader.cpp \
+    ../src/data/EhentaiApi.cpp \
+    ../src/data/ImageHash.cpp \
+    ../src/data/PostingList.cpp \
+    ../src/data/SearchIndex.cpp \
+    ../src/data/SearchTerm.cpp \
+    ../src/DuplicateClusterer.cpp \
+    ../src/FuzzSearcher.cpp
+
+HEADERS += \
+    Benchmark.h \
+    ../src/data/BoundedQueue.h \
+    ../src/data/DataImporter.h \
+    ../src/data/DataStore.h \
+    ../src/data/DatabaseSchema.h \
+    ../src/data/DirWalker.h \
+    ../src/data/EhBackupReader.h \
+    ../src/data/EhentaiApi.h \
+    ../src/data/SearchIndex.h
@@ -0,0 +1,77 @@
+#include "Benchmark.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+#include <functional>
+#include <map>
+#include <optional>
+
+#include "data/DataStore.h"
+
+namespace {
+// titles of the library, they are only read
+QStringList LibraryTitles() {
+    QStringList titles;
+    {
+        auto db = DataStore::OpenReadConnection();
+        auto previews = db ? DataStore::DbListAllFolderPreviews(*db) : std::nullopt;
+        if (previews) {
+            for (const schema::FolderPreview &preview : qAsConst(*previews))
+                titles << preview.title;
+        }
+    }
+    DataStore::CloseThreadConnections();
+    return titles;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("EhDbViewerBenchmark");
+
+    // benchmarks taking a folder get it as the second argument
+    using Run = std::function<QString(const QString &folder)>;
+    const std::map<QString, Run> benchmarks = {
+        {"search-during-import",
+         [](const QString &) { return Benchmark::SearchDuringImport(); }},
+        {"thumbnails",
+         [](const QString &folder) { return Benchmark::Thumbnails(folder); }},
+        {"dir-scan", [](const QString &folder) { return Benchmark::DirScan(folder); }},
+        {"bulk-insert", [](const QString &) { return Benchmark::BulkInsert(); }},
+        {"migration", [](const QString &) { return Benchmark::Migration(); }},
+        {"keyword-matching",
+         [](const QString &) { return Benchmark::KeywordMatching(); }},
+        {"lcs",
+         [](const QString &) {
+             return Benchmark::LongestCommonSubstring(LibraryTitles());
+         }},
+        {"duplicate-clustering",
+         [](const QString &) { return Benchmark::DuplicateClustering(LibraryTitles()); }},
+    };
+    QStringList names;
+    for (const auto &entry : benchmarks)
+        names << entry.first;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Micro benchmarks of the EhDbViewer data layer. Scratch databases are created in "
+        "a temporary directory, the library is only read.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("benchmark", names.join(", "));
+    parser.addPositionalArgument("folder", "sample images for thumbnails, the folder to "
+                                           "scan for dir-scan",
+                                 "[folder]");
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    auto it = args.isEmpty() ? benchmarks.end() : benchmarks.find(args[0]);
+    if (it == benchmarks.end())
+        parser.showHelp(1);
+    const QString folder = args.value(1);
+    if ((it->first == "thumbnails" || it->first == "dir-scan") && folder.isEmpty())
+        parser.showHelp(1);
+
+    QTextStream(stdout) << it->second(folder) << Qt::endl;
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include "DuplicateClusterer.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+#include "FuzzSearcher.h"
+#include "data/ParallelFilter.h"
+
+namespace {
+// 16 bands of 4 hashes: a pair becomes a candidate with a probability of 1/2 at a
+// trigram Jaccard similarity of about 0.5, and of over 0.99 from 0.75
+constexpr int kBands = 16;
+constexpr int kRowsPerBand = 4;
+constexpr int kHashCount = kBands * kRowsPerBand;
+// a title is checked against this many previous members of its bucket only, a bucket
+// of many short identical stems would take quadratic time otherwise
+constexpr int kBucketWindow = 32;
+
+// splitmix64 finalizer
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+struct Signature {
+    QString stem;
+    // min of every hash function over the trigrams of the stem, all max if it has none
+    std::array<uint32_t, kHashCount> minhash;
+    // of the stem, built once the title is known to be in a candidate pair
+    std::optional<SubstringAutomaton> automaton;
+};
+
+// multiply-shift hash functions, seeded so every run gives the same clusters
+struct HashFamily {
+    std::array<uint64_t, kHashCount> mul;
+    std::array<uint64_t, kHashCount> add;
+
+    HashFamily() {
+        for (int i = 0; i < kHashCount; i++) {
+            mul[i] = Mix(2 * i + 1) | 1;
+            add[i] = Mix(2 * i + 2);
+        }
+    }
+    uint32_t hash(int i, uint64_t mixed_gram) const {
+        return uint32_t((mixed_gram * mul[i] + add[i]) >> 32);
+    }
+};
+
+int FindRoot(std::vector<int> *parent, int i) {
+    while ((*parent)[i] != i) {
+        (*parent)[i] = (*parent)[(*parent)[i]];
+        i = (*parent)[i];
+    }
+    return i;
+}
+} // namespace
+
+std::vector<std::vector<int>>
+DuplicateClusterer::Cluster(const QStringList &titles, const QStringList &normalized,
+                            const std::atomic<bool> *cancelled) {
+    QElapsedTimer timer;
+    timer.start();
+    const HashFamily hashes;
+    auto sign_chunk = [&](size_t begin, size_t end, QVector<Signature> *out) {
+        FuzzSearcher searcher; // parseTitle() isn't const
+        QStringList prefixes;
+        for (size_t i = begin; i < end; i++) {
+            Signature signature;
+            signature.minhash.fill(UINT32_MAX);
+            // a signature per title even when cancelled, they are looked up by index
+            if ((!cancelled || !cancelled->load()) &&
+                searcher.parseTitle(titles[int(i)], &prefixes, &signature.stem)) {
+                for (int64_t gram : FuzzSearcher::TitleGrams(signature.stem)) {
+                    const uint64_t mixed = Mix(uint64_t(gram));
+                    for (int h = 0; h < kHashCount; h++) {
+                        signature.minhash[h] =
+                            std::min(signature.minhash[h], hashes.hash(h, mixed));
+                    }
+                }
+            }
+            *out << std::move(signature);
+        }
+    };
+    QVector<Signature> signatures = ParallelFilter<Signature>(titles.size(), sign_chunk);
+    if (cancelled && cancelled->load())
+        return {};
+    qInfo() << "DuplicateClusterer: signed" << signatures.size() << "titles in"
+            << timer.elapsed() << "ms";
+
+    // titles with the same hashes in a band are candidates, packed as low << 32 | high
+    timer.start();
+    std::vector<uint64_t> pairs;
+    std::vector<std::pair<uint64_t, int>> buckets;
+    buckets.reserve(signatures.size());
+    for (int band = 0; band < kBands; band++) {
+        buckets.clear();
+        for (int i = 0; i < signatures.size(); i++) {
+            const auto &minhash = signatures[i].minhash;
+            if (minhash[0] == UINT32_MAX)
+                continue;
+            uint64_t key = band;
+            for (int h = band * kRowsPerBand; h < (band + 1) * kRowsPerBand; h++)
+                key = Mix(key ^ minhash[h]);
+            buckets.emplace_back(key, i);
+        }
+        std::sort(buckets.begin(), buckets.end());
+        size_t run_begin = 0;
+        for (size_t j = 0; j < buckets.size(); j++) {
+            if (buckets[j].first != buckets[run_begin].first)
+                run_begin = j;
+            for (size_t i = std::max(run_begin, j - std::min<size_t>(j, kBucketWindow));
+                 i < j; i++) {
+                pairs.push_back(uint64_t(buckets[i].second) << 32 |
+                                uint32_t(buckets[j].second));
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    qInfo() << "DuplicateClusterer:" << pairs.size() << "candidate pairs in"
+            << timer.elapsed() << "ms";
+
+    timer.start();
+    // a title is in many pairs, its automaton is only built once
+    std::vector<int> members;
+    members.reserve(pairs.size() * 2);
+    for (uint64_t pair : pairs) {
+        members.push_back(int(pair >> 32));
+        members.push_back(int(uint32_t(pair)));
+    }
+    std::sort(members.begin(), members.end());
+    members.erase(std::unique(members.begin(), members.end()), members.end());
+    Signature *signature_data = signatures.data();
+    QtConcurrent::blockingMap(members, [signature_data, cancelled](int i) {
+        if (!cancelled || !cancelled->load())
+            signature_data[i].automaton.emplace(signature_data[i].stem);
+    });
+    if (cancelled && cancelled->load())
+        return {};
+
+    const FuzzSearcher searcher;
+    auto check_chunk = [&](size_t begin, size_t end, QVector<uint64_t> *out) {
+        for (size_t i = begin; i < end; i++) {
+            if (cancelled && cancelled->load())
+                break;
+            const int a = int(pairs[i] >> 32);
+            const int b = int(uint32_t(pairs[i]));
+            const Signature &sig_a = signatures.at(a);
+            const Signature &sig_b = signatures.at(b);
+            if (searcher.matchesStem(normalized[b], sig_a.stem, *sig_a.automaton) &&
+                searcher.matchesStem(normalized[a], sig_b.stem, *sig_b.automaton))
+                *out << pairs[i];
+        }
+    };
+    const QVector<uint64_t> matched = ParallelFilter<uint64_t>(pairs.size(), check_chunk);
+    if (cancelled && cancelled->load())
+        return {};
+
+    std::vector<int> parent(titles.size());
+    for (int i = 0; i < int(parent.size()); i++)
+        parent[i] = i;
+    for (uint64_t pair : matched) {
+        const int a = FindRoot(&parent, int(pair >> 32));
+        const int b = FindRoot(&parent, int(uint32_t(pair)));
+        // the smaller index is the root, so it's the first of its cluster
+        parent[std::max(a, b)] = std::min(a, b);
+    }
+    std::vector<std::vector<int>> ret;
+    std::vector<int> cluster_of(titles.size(), -1);
+    for (int i = 0; i < int(parent.size()); i++) {
+        const int root = FindRoot(&parent, i);
+        if (root == i)
+            continue;
+        if (cluster_of[root] < 0) {
+            cluster_of[root] = int(ret.size());
+            ret.push_back({root});
+        }
+        ret[cluster_of[root]].push_back(i);
+    }
+    // created in order of their second member
+    std::sort(ret.begin(), ret.end());
+    qInfo() << "DuplicateClusterer:" << matched.size() << "pairs verified into"
+            << ret.size() << "clusters in" << timer.elapsed() << "ms";
+    return ret;
+}
@@ -0,0 +1,25 @@
+#ifndef DUPLICATECLUSTERER_H
+#define DUPLICATECLUSTERER_H
+
+#include <QStringList>
+#include <atomic>
+#include <vector>
+
+// Clusters the near duplicate titles of a whole library, e.g. a gallery downloaded
+// twice under slightly different folder names.
+// Candidate pairs come from MinHash/LSH over the trigrams of the title stems, so the
+// work grows with the library instead of one similar_to: query per title. A pair is
+// kept if each title matches the stem of the other by the rule of
+// FuzzSearcher::matchesStem(), clusters are the connected components of the kept
+// pairs. Signatures and checks run on the global thread pool.
+class DuplicateClusterer {
+  public:
+    // `normalized` holds the FuzzSearcher::NormalizeTitle() of each of `titles`.
+    // Returns clusters of at least two indexes, each sorted, ordered by first index.
+    // Stops early and returns {} once *cancelled is set.
+    static std::vector<std::vector<int>> Cluster(const QStringList &titles,
+                                                 const QStringList &normalized,
+                                                 const std::atomic<bool> *cancelled);
+};
+
+#endif // DUPLICATECLUSTERER_H
@@ -3,6 +3,72 @@
 #include <memory>
 #include <stdexcept>
 
+SubstringAutomaton::SubstringAutomaton(QStringView s) {
+    states_.reserve(2 * s.size() + 1);
+    states_.push_back({0, -1, {}});
+    int last = 0;
+    for (QChar qch : s) {
+        const char16_t ch = qch.unicode();
+        const int cur = states_.size();
+        states_.push_back({states_[last].len + 1, -1, {}});
+        int p = last;
+        while (p != -1 && transition(p, ch) == -1) {
+            states_[p].next.emplace_back(ch, cur);
+            p = states_[p].link;
+        }
+        if (p == -1) {
+            states_[cur].link = 0;
+        } else {
+            const int q = transition(p, ch);
+            if (states_[p].len + 1 == states_[q].len) {
+                states_[cur].link = q;
+            } else {
+                const int clone = states_.size();
+                states_.push_back({states_[p].len + 1, states_[q].link, states_[q].next});
+                while (p != -1 && transition(p, ch) == q) {
+                    for (auto &edge : states_[p].next) {
+                        if (edge.first == ch)
+                            edge.second = clone;
+                    }
+                    p = states_[p].link;
+                }
+                states_[q].link = clone;
+                states_[cur].link = clone;
+            }
+        }
+        last = cur;
+    }
+}
+
+int SubstringAutomaton::transition(int state, char16_t ch) const {
+    for (const auto &edge : states_[state].next) {
+        if (edge.first == ch)
+            return edge.second;
+    }
+    return -1;
+}
+
+int SubstringAutomaton::longestCommonSubstring(QStringView other) const {
+    // walk `other`, following suffix links when the current match can't be extended
+    int state = 0;
+    int len = 0;
+    int best = 0;
+    for (QChar qch : other) {
+        const char16_t ch = qch.unicode();
+        while (state != 0 && transition(state, ch) == -1) {
+            state = states_[state].link;
+            len = states_[state].len;
+        }
+        const int next = transition(state, ch);
+        if (next != -1) {
+            state = next;
+            len++;
+        }
+        best = std::max(best, len);
+    }
+    return best;
+}
+
 QString FuzzSearcher::Lcs(const QString &a, const QString &b) {
     if (a.isEmpty() || b.isEmpty())
         return "";
@@ -151,3 +217,90 @@ bool FuzzSearcher::parsePrefixStem(QString s, QStringList *prefixes, QString *st
     *prefixes = flatternComponents(*prefixes);
     return true;
 }
+
+bool FuzzSearcher::parseTitle(const QString &title, QStringList *prefixes,
+                             QString *stem) {
+    thread_local const QRegularExpression ignore_prefix{"^[cC][0-9]{2}$"}; // C89 etc.
+    if (!parsePrefixStem(Nfkc(title), prefixes, stem))
+        return false;
+    *stem = NormalizeTitle(*stem);
+    QStringList tmp = *prefixes;
+    prefixes->clear();
+    for (const QString &p : qAsConst(tmp)) {
+        QString normalized = NormalizeTitle(p);
+        if (!ignore_prefix.match(normalized).hasMatch())
+            *prefixes << normalized;
+    }
+    return true;
+}
+
+QString FuzzSearcher::NormalizeTitle(const QString &title) {
+    // one per thread, QRegularExpression isn't thread safe
+    thread_local const QRegularExpression non_word_char{
+        "\\W", QRegularExpression::UseUnicodePropertiesOption};
+    return Nfkc(title).remove(non_word_char);
+}
+
+std::vector<int64_t> FuzzSearcher::TitleGrams(QStringView normalized) {
+    std::vector<int64_t> ret;
+    for (int i = 0; i + kGramLength <= int(normalized.size()); i++) {
+        int64_t gram = 0;
+        for (int j = i; j < i + kGramLength; j++)
+            gram = (gram << 16) | normalized[j].unicode();
+        ret.push_back(gram);
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+std::optional<std::vector<int64_t>> FuzzSearcher::candidateGrams(const QString &base) {
+    // empty candidates match without sharing anything
+    if (!ignore_too_short_candidates_ || min_match_length_ < kGramLength)
+        return {};
+    QStringList prefixes;
+    QString stem;
+    if (!parseTitle(base, &prefixes, &stem))
+        return std::vector<int64_t>{};
+    // a common substring at least min_match_length_ long has a trigram of the stem
+    std::vector<int64_t> ret = TitleGrams(stem);
+    if (include_prefix_matching_) {
+        for (const QString &p : qAsConst(prefixes)) {
+            if (p.size() < kGramLength)
+                return {};
+            // containing the prefix means containing its first trigram
+            ret.push_back(TitleGrams(QStringView(p).left(kGramLength)).front());
+        }
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+bool FuzzSearcher::matchesCandidate(const QString &candidate, const QStringList &prefixes,
+                                    const QString &stem,
+                                    const SubstringAutomaton &stem_automaton) const {
+    bool matches = false;
+    const QString &s = candidate;
+
+    if (include_prefix_matching_) {
+        for (const QString &p : prefixes) {
+            if (s.contains(p)) {
+                matches = true;
+                break;
+            }
+        }
+    }
+
+    return matches || matchesStem(s, stem, stem_automaton);
+}
+
+bool FuzzSearcher::matchesStem(const QString &candidate, const QString &stem,
+                               const SubstringAutomaton &stem_automaton) const {
+    const QString &s = candidate;
+    int lcs_len = stem_automaton.longestCommonSubstring(s);
+    int min_len = std::min(s.size(), stem.size());
+    if (s.length() < min_match_threshold_)
+        return !(ignore_too_short_candidates_) && lcs_len >= min_len;
+    return lcs_len >= min_match_length_ && lcs_len > min_len * min_match_threshold_;
+}
@@ -7,13 +7,41 @@
 #include <QRegularExpression>
 #include <QSet>
 #include <QString>
+#include <QStringView>
+#include <QVector>
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <optional>
+#include <vector>
+
+#include "data/ParallelFilter.h"
+
+// Suffix automaton of a string. Built in O(n), it then answers the length of the
+// longest common substring of that string and any other in O(length of the other),
+// against O(n * m) for FuzzSearcher::Lcs(). Thread safe once built.
+class SubstringAutomaton {
+  public:
+    explicit SubstringAutomaton(QStringView s);
+    int longestCommonSubstring(QStringView other) const;
+
+  private:
+    struct State {
+        int len;  // length of the longest substring ending in this state
+        int link; // suffix link, -1 for the initial state
+        // few per state, a linear scan beats a hash
+        std::vector<std::pair<char16_t, int>> next;
+    };
+    int transition(int state, char16_t ch) const;
+
+    std::vector<State> states_;
+};
 
 class FuzzSearcher {
   public:
-    // Longest common substring
+    // Longest common substring, see SubstringAutomaton when only the length is needed
     static QString Lcs(const QString &a, const QString &b);
     static QString Nfkc(const QString &s);
     static int IndexOfAny(const QString &s, const QSet<QChar> &chars);
@@ -25,71 +53,62 @@ class FuzzSearcher {
     QStringList flatternComponents(const QStringList &slist);
     // return true if success
     bool parsePrefixStem(QString s, QStringList *prefixes, QString *stem);
+    // Prefixes and stem of a title in the form they are compared in: NFKC, without non
+    // word characters, prefixes like "C89" dropped. Return false if it can't be parsed.
+    bool parseTitle(const QString &title, QStringList *prefixes, QString *stem);
+    // The form candidate titles are compared in: NFKC, without non word characters.
+    // Thread safe.
+    static QString NormalizeTitle(const QString &title);
+
+    static constexpr int kGramLength = 3;
+    // Distinct trigrams of a NormalizeTitle() form, each packed into an integer.
+    static std::vector<int64_t> TitleGrams(QStringView normalized);
+    // Trigrams of which a candidate of filterMatching() has at least one if it matches
+    // `base`, empty if nothing can match. {} if the candidates can't be narrowed down,
+    // e.g. a prefix shorter than a trigram matches whatever contains it.
+    std::optional<std::vector<int64_t>> candidateGrams(const QString &base);
+
+    // `key` returns the NormalizeTitle() of a candidate, e.g. from the title_norms
+    // table, so no unicode pass is made over the candidates.
+    // Candidates are matched by chunks on the global thread pool, `key` must be thread
+    // safe. The result keeps the order of `list`.
+    // stops early and returns a partial result once *cancelled is set
     template <typename T>
-    QList<T> filterMatching(const QList<T> &list, QString base,
-                            const std::function<QString(const T &)> &key) {
-        QList<T> ret;
+    QVector<T> filterMatching(const QVector<T> &list, const QString &base,
+                              const std::function<QString(const T &)> &key,
+                              const std::atomic<bool> *cancelled = nullptr) {
         QStringList prefixes;
         QString stem;
-        QRegularExpression non_word_char{"\\W",
-                                         QRegularExpression::UseUnicodePropertiesOption};
-        QRegularExpression ignore_prefix{"^[cC][0-9]{2}$"}; // C89 etc.
-
-        base = Nfkc(base);
-        if (!parsePrefixStem(base, &prefixes, &stem)) {
-            qWarning() << "parsePrefixStem() failed" << base;
-            return ret;
+        if (!parseTitle(base, &prefixes, &stem)) {
+            qWarning() << "parseTitle() failed" << base;
+            return {};
         }
         qDebug() << "prefixes:" << prefixes;
         qDebug() << "stem:" << stem;
-        for (QString &p : prefixes)
-            p.replace(non_word_char, "");
-        stem.replace(non_word_char, "");
-        qInfo() << prefixes;
-        {
-            QStringList tmp = prefixes;
-            prefixes.clear();
-            for (const QString &p : tmp) {
-                if (!ignore_prefix.match(p).hasMatch()) {
-                    prefixes << p;
-                }
-            }
-        }
-        qDebug() << "prefixes after:" << prefixes;
-        qDebug() << "stem after:" << stem;
-
-        for (const T &candidate : list) {
-            bool matches = false;
-            QString s = Nfkc(key(candidate));
-            s.replace(non_word_char, "");
-
-            if (include_prefix_matching_) {
-                for (const QString &p : qAsConst(prefixes)) {
-                    if (s.contains(p)) {
-                        matches = true;
-                        break;
-                    }
-                }
-            }
 
-            if (!matches) {
-                int lcs_len = Lcs(s, stem).size();
-                int min_len = std::min(s.size(), stem.size());
-                if (s.length() < min_match_threshold_) {
-                    matches = !(ignore_too_short_candidates_) && lcs_len >= min_len;
-                } else {
-                    matches = lcs_len >= min_match_length_ &&
-                              lcs_len > min_len * min_match_threshold_;
-                }
+        const SubstringAutomaton stem_automaton{stem};
+        auto match_chunk = [&](size_t chunk_begin, size_t chunk_end, QVector<T> *out) {
+            for (size_t i = chunk_begin; i < chunk_end; i++) {
+                if (cancelled && cancelled->load())
+                    break;
+                if (matchesCandidate(key(list[int(i)]), prefixes, stem, stem_automaton))
+                    *out << list[int(i)];
             }
-
-            if (matches)
-                ret << candidate;
-        }
-        return ret;
+        };
+        return ParallelFilter<T>(list.size(), match_chunk);
     }
 
+    // The stem rule of filterMatching(): `candidate`, a key, shares a long enough
+    // substring with `stem` from parseTitle(). Thread safe.
+    bool matchesStem(const QString &candidate, const QString &stem,
+                     const SubstringAutomaton &stem_automaton) const;
+
   private:
+    // `candidate` is a key of filterMatching(), the rest is prepared from its base
+    bool matchesCandidate(const QString &candidate, const QStringList &prefixes,
+                          const QString &stem,
+                          const SubstringAutomaton &stem_automaton) const;
+
     QString parenthesis_ = QString::fromUtf8(
         "()[]{}“”‹›«»（）［］｛｝｟｠「」〈〉《》【】〔〕⦗⦘『』〖〗〘〙｢｣");
     QMap<QChar, QChar> mapping_; // map from open bracket to closing bracket
@@ -0,0 +1,75 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <optional>
+#include <vector>
+
+// Blocking FIFO with a fixed capacity, connects the stages of a pipeline.
+// push() blocks while the queue is full, so a slow stage holds back the ones feeding it.
+template <typename T> class BoundedQueue {
+  public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+    // return false if the queue is closed, `item` is dropped then
+    bool push(T item) {
+        QMutexLocker locker(&mutex_);
+        while (!closed_ && items_.size() >= capacity_)
+            not_full_.wait(&mutex_);
+        if (closed_)
+            return false;
+        items_.push_back(std::move(item));
+        not_empty_.wakeOne();
+        return true;
+    }
+
+    // block until an item is available, return {} once the queue is closed and drained
+    std::optional<T> pop() {
+        QMutexLocker locker(&mutex_);
+        while (!closed_ && items_.empty())
+            not_empty_.wait(&mutex_);
+        if (items_.empty())
+            return {};
+        std::optional<T> ret{std::move(items_.front())};
+        items_.pop_front();
+        not_full_.wakeOne();
+        return ret;
+    }
+
+    // Append up to max_count items to *out, blocking until at least one is available.
+    // Return false once the queue is closed and drained.
+    bool popBatch(std::vector<T> *out, size_t max_count) {
+        QMutexLocker locker(&mutex_);
+        while (!closed_ && items_.empty())
+            not_empty_.wait(&mutex_);
+        if (items_.empty())
+            return false;
+        for (size_t i = 0; i < max_count && !items_.empty(); i++) {
+            out->push_back(std::move(items_.front()));
+            items_.pop_front();
+        }
+        not_full_.wakeAll();
+        return true;
+    }
+
+    // Refuse further push(), blocked callers return. Items already queued can still be
+    // popped.
+    void close() {
+        QMutexLocker locker(&mutex_);
+        closed_ = true;
+        not_full_.wakeAll();
+        not_empty_.wakeAll();
+    }
+
+  private:
+    const size_t capacity_;
+    QMutex mutex_;
+    QWaitCondition not_full_;
+    QWaitCondition not_empty_;
+    std::deque<T> items_;
+    bool closed_ = false;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -1,21 +1,41 @@
 #include "DataImporter.h"
+#include "BoundedQueue.h"
 #include "DataStore.h"
 #include "DatabaseSchema.h"
+#include "DirWalker.h"
+#include "EhBackupReader.h"
 
 #include <QApplication>
 #include <QBuffer>
 #include <QColorSpace>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QImage>
+#include <QImageReader>
 #include <QLabel>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <QtConcurrent>
 #include <QtSql>
 
 #include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <map>
 #include <string>
 
-const QString DataImporter::kNoImageBase64 =
+namespace {
+// folders per write transaction of an import or update
+constexpr size_t kWriteBatchSize = 128;
+} // namespace
+
+const QByteArray DataImporter::kNoImage = QByteArray::fromBase64(
     "iVBORw0KGgoAAAANSUhEUgAAAGQAAABkCAYAAABw4pVUAAAABmJLR0QA/wD/AP+gvaeTAAAEJElEQVR4"
     "nO3dv49MURTA8e8Ku4kIiUKCRKHRaFQqlYqCjdiQkCgp7Cr5Eyh1dHTb6VSikbAaK1HQiFixiSAhg8Ku"
     "XcWbiTFz38977jtnZs43ec3uvDt35pP33sydNcDzPM/z5JoDvgAfgVnluUx8U8BnYLO7rQHnVGfk8Yl/"
@@ -34,175 +54,490 @@ const QString DataImporter::kNoImageBase64 =
     "blScqHahU8pLbJ2+okGuVJygdrPUf4I0UKJBRqUPNHti20aZSJC6r3zaRJkYkBNkKCs0+wi2LZSJAZGo"
     "jVdfDlKz1CgO0qCUKA7SsFTXFAeJKMWR4iCRpUYpzUGGS4lSmoOES4VSmoPkJ3GhdxDh1D8P8YZT/TzE"
     "C9cUJRrEt7T/qU1p2g/e6pYKpTTtB255S4FSmvaDtr5Jo3gJG9V/iDrWOYrBHMVgjmIwRzGYoxgsb5X4"
-    "tOakJr0QyorqjLwhlFXd6XiQnabekR0dp5Tn4nme541RfwFbbDokN3PzagAAAABJRU5ErkJggg==";
+    "tOakJr0QyorqjLwhlFXd6XiQnabekR0dp5Tn4nme541RfwFbbDokN3PzagAAAABJRU5ErkJggg==");
+
+QImage DataImporter::LoadScaledImage(const QString &file_path) {
+    auto thumbnail_box = [](QSize size) {
+        return size.width() > size.height() ? QSize(320, 200) : QSize(200, 320);
+    };
+
+    QImageReader reader(file_path);
+    // only reads the header
+    QSize full_size = reader.size();
+    if (full_size.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        // The jpeg decoder then skips most of the pixels (DCT domain downscaling).
+        // Twice the final size leaves enough detail for the smooth scaling below.
+        QSize decode_size =
+            full_size.scaled(thumbnail_box(full_size) * 2, Qt::KeepAspectRatio);
+        if (decode_size.width() < full_size.width())
+            reader.setScaledSize(decode_size);
+    }
+    // full decode if the format can't do better, e.g. png
+    QImage image = reader.read();
+    if (image.isNull())
+        return {};
+    // aspect ratio of the decoded image, the header may be absent or wrong
+    return image.scaled(thumbnail_box(image.size()), Qt::KeepAspectRatio,
+                        Qt::SmoothTransformation);
+}
 
-QString DataImporter::GenerateImgThumbnail(const QString &file_path) {
+QByteArray DataImporter::EncodeThumbnail(QImage image) {
+    if (image.isNull())
+        return {};
     QByteArray byte_arr;
     QBuffer buffer(&byte_arr);
     buffer.open(QIODevice::WriteOnly);
 
-    QImage image(file_path);
-    if (image.isNull())
-        return "";
-    if (image.width() > image.height()) {
-        image = image.scaled(320, 200, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    } else {
-        image = image.scaled(200, 320, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    }
-
-    if (image.isNull())
-        return "";
     image.convertToColorSpace(QColorSpace::SRgb);
 
     if (!image.save(&buffer, "JPG", 85))
-        return "";
-    auto base64 = byte_arr.toBase64();
-    // qDebug() << "thumbnail base64 size " << base64.size() / 1024 << "KB";
-    return base64;
+        return {};
+    // qDebug() << "thumbnail size " << byte_arr.size() / 1024 << "KB";
+    return byte_arr;
 }
 
-std::optional<QString> DataImporter::ScanFolder(const QDir &dir,
-                                                std::vector<FolderData> *output_list,
-                                                QProgressDialog *progress) {
-    if (progress->wasCanceled())
-        return "User cancelled";
+QByteArray DataImporter::GenerateImgThumbnail(const QString &file_path) {
+    return EncodeThumbnail(LoadScaledImage(file_path));
+}
 
-    std::optional<QFileInfo> pic_info{};
-    bool has_folder = false;
+std::optional<QString> DataImporter::RunImportPipeline(QWidget *parent,
+                                                       FolderSource source,
+                                                       FolderWriter writer,
+                                                       int64_t journal_id,
+                                                       int64_t *written_count,
+                                                       ImportFinisher finish) {
+    constexpr size_t kQueueCapacity = 64;
+    const int cores = std::max(2, QThread::idealThreadCount());
+    // decoding is several times slower than encoding the small result
+    const int decoder_count = std::max(1, cores * 3 / 4);
+    const int encoder_count = std::max(1, cores - decoder_count);
+
+    BoundedQueue<FolderData> scanned{kQueueCapacity};
+    BoundedQueue<FolderData> decoded{kQueueCapacity};
+    BoundedQueue<FolderData> encoded{kQueueCapacity};
+    std::atomic<bool> cancelled{false};
+    std::atomic<int64_t> scanned_count{0};
+    std::atomic<int64_t> encoded_count{0};
+    std::atomic<int64_t> written{0};
+    std::atomic<int> decoders_running{decoder_count};
+    std::atomic<int> encoders_running{encoder_count};
+
+    QMutex error_mutex;
+    std::optional<QString> error;
+    auto cancel = [&] {
+        cancelled = true;
+        scanned.close();
+        decoded.close();
+        encoded.close();
+    };
+    // the first error is reported, the others are most likely caused by it
+    auto fail = [&](const QString &message) {
+        {
+            QMutexLocker locker(&error_mutex);
+            if (!error)
+                error = message;
+        }
+        cancel();
+    };
 
-    const auto stupid_qt = dir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries);
-    for (const auto &info : stupid_qt) {
-        if (info.isFile()) {
-            if (pic_info)
-                continue;
-            auto ext = info.suffix().toLower();
-            if (ext == "jpg" || ext == "png" || ext == "jpeg") {
-                pic_info = info;
+    // every stage runs at the same time, or the queues would deadlock
+    QThreadPool pool;
+    pool.setMaxThreadCount(decoder_count + encoder_count + 2);
+
+    QtConcurrent::run(&pool, [&] {
+        auto err = source([&](FolderData folder) {
+            scanned_count++;
+            return !cancelled && scanned.push(std::move(folder));
+        });
+        if (err && !cancelled)
+            fail(*err);
+        scanned.close();
+        DataStore::CloseThreadConnections();
+    });
+    for (int i = 0; i < decoder_count; i++) {
+        QtConcurrent::run(&pool, [&] {
+            while (auto folder = scanned.pop()) {
+                if (cancelled)
+                    break;
+                if (!folder->cover_fname.isEmpty())
+                    folder->cover =
+                        LoadScaledImage(folder->folder.filePath(folder->cover_fname));
+                if (!decoded.push(std::move(*folder)))
+                    break;
+            }
+            if (--decoders_running == 0)
+                decoded.close();
+        });
+    }
+    for (int i = 0; i < encoder_count; i++) {
+        QtConcurrent::run(&pool, [&] {
+            while (auto folder = decoded.pop()) {
+                if (cancelled)
+                    break;
+                folder->thumbnail = EncodeThumbnail(std::move(folder->cover));
+                folder->cover = QImage();
+                if (folder->thumbnail.isEmpty())
+                    folder->thumbnail = kNoImage;
+                encoded_count++;
+                if (!encoded.push(std::move(*folder)))
+                    break;
             }
-        } else if (info.isDir()) {
-            auto err = ScanFolder({info.absoluteFilePath()}, output_list, progress);
-            if (err)
-                return err;
-            has_folder = true;
+            if (--encoders_running == 0)
+                encoded.close();
+        });
+    }
+    // Commit the batch or the finishing step, together with the journal, so an
+    // interrupted import knows exactly what is in the db. The write lock is released
+    // between batches. Return false if error.
+    auto commit = [&](const std::vector<FolderData> *batch) {
+        std::optional<QString> err;
+        auto transaction_err = DataStore::DbTransaction([&](QSqlDatabase *db) {
+            if (batch)
+                err = writer(db, *batch);
+            else if (finish)
+                err = finish(db);
+            if (!err && !DataStore::DbUpdateImportJournalReqTransaction(
+                            *db, journal_id, batch ? batch->size() : 0, !batch))
+                err = "failed to update import_journal";
+            return !err;
+        });
+        if (transaction_err || err) {
+            fail(transaction_err ? *transaction_err : *err);
+            return false;
+        }
+        return true;
+    };
+    QFuture<void> writer_future = QtConcurrent::run(&pool, [&] {
+        std::vector<FolderData> batch;
+        while (encoded.popBatch(&batch, kWriteBatchSize)) {
+            if (cancelled || !commit(&batch))
+                break;
+            written += batch.size();
+            batch.clear();
+        }
+        if (!cancelled)
+            commit(nullptr);
+        // this thread goes away with the pool
+        DataStore::CloseThreadConnections();
+    });
+
+    // progress dialog
+    QProgressDialog progress("", "Abort", 0, 0, parent);
+    auto label = new QLabel();
+    label->setAlignment(Qt::AlignLeft);
+    progress.setLabel(label);
+
+    progress.setMinimumDuration(0);
+    progress.setMinimumWidth(500);
+    progress.setModal(Qt::WindowModal);
+    progress.setValue(0);
+    progress.setLabelText("Scanning folders...");
+
+    QEventLoop loop;
+    QFutureWatcher<void> watcher;
+    QObject::connect(&watcher, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+    QTimer timer;
+    QObject::connect(&timer, &QTimer::timeout, [&] {
+        if (progress.wasCanceled() && !cancelled) {
+            fail("user cancelled");
+            return;
+        }
+        progress.setMaximum(scanned_count);
+        progress.setValue(written);
+        progress.setLabelText(QString("Found %1 folders\nGenerated %2 thumbnails\n"
+                                      "Imported %3 folders")
+                                  .arg(scanned_count)
+                                  .arg(encoded_count)
+                                  .arg(written));
+    });
+    timer.start(100);
+    watcher.setFuture(writer_future);
+    loop.exec();
+    timer.stop();
+
+    // wake up the other stages if the writer stopped early
+    if (error)
+        cancel();
+    pool.waitForDone();
+    *written_count = written;
+    return error;
+}
+
+std::optional<QString> DataImporter::ScanFolder(const QDir &dir, bool full_rescan,
+                                                const FolderSink &sink,
+                                                ScanChanges *changes) {
+    QElapsedTimer timer;
+    timer.start();
+    const QString root = QFileInfo(dir.absolutePath()).absoluteFilePath();
+    const int64_t scan_time = QDateTime::currentSecsSinceEpoch();
+
+    // what the last scans recorded below root
+    QHash<QString, schema::DirFingerprints> known;
+    QHash<QString, QStringList> known_subdirs;
+    {
+        auto db = DataStore::OpenReadConnection();
+        if (!db)
+            return "failed to open database";
+        auto fingerprints = DataStore::DbListDirFingerprints(*db, root);
+        if (!fingerprints)
+            return "failed to read dir_fingerprints";
+        for (schema::DirFingerprints &fp : *fingerprints) {
+            if (fp.parent != fp.path)
+                known_subdirs[fp.parent] << fp.path;
+            QString path = fp.path;
+            known.insert(path, std::move(fp));
         }
     }
 
-    //    if (pic_info && has_folder) {
-    //        return QString("Unable to process folder containing both picture and
-    //        subfolder: %1").arg(dir.absolutePath());
-    //    }
-
-    if (pic_info) {
-        output_list->push_back({.folder = dir,
-                                .cover_fname = pic_info->fileName(),
-                                .thumb_base64 = "",
-                                .record_time = pic_info->lastModified()});
-        progress->setLabelText(QString("Scanning folder: %1").arg(dir.dirName()));
-        // qInfo() << QString("Scanning folder: %1").arg(dir.dirName());
-        QApplication::processEvents();
+    QMutex mutex;
+    QSet<QString> visited;
+    QStringList candidates;
+    DirWalker walker;
+    walker.setListingCache(
+        [&](const QString &path, const DirWalker::Fingerprint &fingerprint)
+            -> std::optional<DirWalker::Listing> {
+            auto it = known.constFind(path);
+            bool unchanged = !full_rescan && it != known.cend() &&
+                             it->inode == fingerprint.inode &&
+                             it->mtime_ns == fingerprint.mtime_ns &&
+                             // modified right before it was listed: a later change in
+                             // the same mtime tick would go unnoticed
+                             it->mtime_ns / 1000000000 < it->scanned_at - 2;
+            if (!unchanged)
+                return {};
+            QMutexLocker locker(&mutex);
+            visited << path;
+            return DirWalker::Listing{.cover_fname = it->cover_fname,
+                                      .subdirs = known_subdirs.value(path),
+                                      .entry_count = it->entry_count};
+        },
+        [&](const QString &path, const DirWalker::Fingerprint &fingerprint,
+            const DirWalker::Listing &listing) {
+            int slash = path.lastIndexOf('/');
+            schema::DirFingerprints fp{
+                .path = path,
+                .parent = slash > 0 ? path.left(slash) : path.left(1),
+                .inode = fingerprint.inode,
+                .mtime_ns = fingerprint.mtime_ns,
+                .entry_count = listing.entry_count,
+                .cover_fname = listing.cover_fname,
+                .scanned_at = scan_time,
+            };
+            QMutexLocker locker(&mutex);
+            visited << path;
+            changes->listed.push_back(std::move(fp));
+        });
+    bool completed = walker.walk(root, [&](const DirWalker::ImageFolder &folder) {
+        QMutexLocker locker(&mutex);
+        candidates << folder.path;
+        return true;
+    });
+    qInfo() << "ScanFolder() listed" << walker.dirsListed() << "folders, reused"
+            << walker.dirsFromCache() << "in" << timer.elapsed() << "ms";
+    if (!completed)
+        return "User cancelled";
+    if (!visited.contains(root))
+        return QString("Failed to read %1").arg(root);
+    // e.g. the empty mount point of an unmounted drive, which lists fine
+    auto root_listing = std::find_if(
+        changes->listed.cbegin(), changes->listed.cend(),
+        [&root](const schema::DirFingerprints &fp) { return fp.path == root; });
+    if (root_listing != changes->listed.cend() && root_listing->entry_count == 0 &&
+        known_subdirs.contains(root))
+        return QString("%1 is empty but had subfolders, not removing them").arg(root);
+    // what is below an unreadable folder is unknown, not removed
+    const QStringList failed = walker.failedDirs();
+    auto under_failed = [&failed](const QString &path) {
+        return std::any_of(failed.cbegin(), failed.cend(), [&path](const QString &dir) {
+            return path == dir ||
+                   path.startsWith(dir.endsWith('/') ? dir : dir + '/');
+        });
+    };
+    for (auto it = known.cbegin(); it != known.cend(); ++it) {
+        if (!visited.contains(it.key()) && !under_failed(it.key()))
+            changes->removed << it.key();
+    }
+
+    // only changed folders are candidates, so this is a small lookup on a rescan
+    std::optional<QSet<QString>> existing;
+    {
+        auto db = DataStore::OpenReadConnection();
+        if (db)
+            existing = DataStore::DbListExistingFolders(*db, candidates);
+    }
+    if (!existing)
+        return "failed to read img_folders";
+    QHash<QString, QString> covers;
+    for (const schema::DirFingerprints &fp : changes->listed)
+        covers.insert(fp.path, fp.cover_fname);
+    for (const QString &path : qAsConst(candidates)) {
+        if (existing->contains(path))
+            continue;
+        QDir folder_dir{path};
+        QString cover_fname = covers.value(path);
+        // the only file of the folder that is stat()ed
+        QFileInfo cover_info{folder_dir.filePath(cover_fname)};
+        if (!sink({.folder = folder_dir,
+                   .cover_fname = cover_fname,
+                   .thumbnail = {},
+                   .record_time = cover_info.lastModified(),
+                   .eh_data = {},
+                   .cover = {}}))
+            return "User cancelled";
     }
     return {};
 }
 
-QString DataImporter::ImportDir(QDir dir, QWidget *parent) {
-    QString ret = "";
-    auto transaction_msg = DataStore::DbTransaction([dir, parent,
-                                                     &ret](QSqlDatabase *db) -> bool {
-        // progress dialog
-        QProgressDialog progress("", "Abort", 0, 0, parent);
-        auto label = new QLabel();
-        label->setAlignment(Qt::AlignLeft);
-        progress.setLabel(label);
-
-        progress.setMinimumDuration(0);
-        progress.setMinimumWidth(500);
-        progress.setModal(Qt::WindowModal);
-        progress.setValue(0);
-        progress.setLabelText("Scanning folders...");
-        QApplication::processEvents();
-
-        // scan dir tree -> (folder_path, img_path)
-        std::vector<FolderData> discovered_folders;
-        auto err = ScanFolder(dir, &discovered_folders, &progress);
-        if (err) {
-            ret = QString("Error: %1").arg(*err);
-            return false;
-        }
+std::optional<QString>
+DataImporter::InsertScannedFolders(QSqlDatabase *db,
+                                   const std::vector<FolderData> &batch) {
+    auto count = DataStore::DbMaxFid(*db);
+    if (!count) {
+        qCritical() << "failed to query max fid from main db";
+        return "database err";
+    }
 
-        // filter out folders that's already in database
-        auto db_folders = DataStore::DbListAllFolders(*db);
-        if (!db_folders) {
-            ret = "Error: DbListAllFolders() failed";
-            return false;
-        }
-        discovered_folders.erase(
-            std::remove_if(discovered_folders.begin(), discovered_folders.end(),
-                           [&db_folders](const FolderData &d) {
-                               return db_folders->contains(d.folder.absolutePath());
-                           }),
-            discovered_folders.end());
-
-        // process files -> (folder_path, img_path, bas64)
-        progress.setMaximum(discovered_folders.size());
-        progress.setValue(0);
-        for (size_t idx = 0; idx < discovered_folders.size(); idx++) {
-            if (progress.wasCanceled()) {
-                ret = QString("Error: user cancelled");
-                return false;
-            }
-            auto &folder = discovered_folders[idx];
-            folder.thumb_base64 =
-                GenerateImgThumbnail(folder.folder.filePath(folder.cover_fname));
-            progress.setLabelText(
-                QString("Generating thumbnail: %1").arg(folder.folder.dirName()));
-            progress.setValue(idx);
-        }
+    int64_t next_fid = *count + 1;
+    std::vector<schema::ImageFolders> folders;
+    std::vector<schema::CoverImages> covers;
+    folders.reserve(batch.size());
+    covers.reserve(batch.size());
+    for (const auto &folder : batch) {
+        int64_t fid = next_fid++;
+        folders.push_back({.fid = fid,
+                           .folder_path = folder.folder.absolutePath(),
+                           .title = folder.folder.dirName(),
+                           .record_time = folder.record_time.toSecsSinceEpoch(),
+                           .eh_gid = ""});
+        covers.push_back({
+            .fid = fid,
+            .cover_fname = folder.cover_fname,
+            .cover = folder.thumbnail,
+        });
+    }
+    if (!DataStore::DbBulkInsert(*db, folders) || !DataStore::DbBulkInsert(*db, covers))
+        return "failed to insert to db";
+    return {};
+}
 
-        // insert to db
-        auto count = DataStore::DbMaxFid(*db);
-        if (!count) {
-            qCritical() << "failed to query max fid from main db";
-            ret = "Error: database err";
-            return false;
-        }
+namespace {
+// backup entries checked against img_folders per query
+constexpr size_t kBackupLookupBatch = 256;
+
+// "Import complete" or "Error" message of an import run
+QString ImportResultMessage(const std::optional<QString> &err,
+                            const schema::ImportJournal &journal, int64_t imported,
+                            const QString &complete_message) {
+    if (err) {
+        return QString("Error: %1\n%2 folders were imported before it stopped, import "
+                       "again to resume.")
+            .arg(*err)
+            .arg(imported);
+    }
+    if (journal.imported > 0) {
+        return QString("Resumed an import interrupted after %1 folders.\n%2")
+            .arg(journal.imported)
+            .arg(complete_message);
+    }
+    return complete_message;
+}
+} // namespace
+
+QString DataImporter::ImportDir(QDir dir, QWidget *parent, bool full_rescan) {
+    auto db = DataStore::OpenDatabase().value();
+    auto journal = DataStore::DbBeginImport(
+        db, "folder", QFileInfo(dir.absolutePath()).absoluteFilePath());
+    if (!journal)
+        return "Error: failed to read import_journal";
+
+    // filled by the scan thread, written by the writer thread after the last folder
+    ScanChanges changes;
+    auto source = [dir, full_rescan, &changes](const FolderSink &sink) {
+        return ScanFolder(dir, full_rescan, sink, &changes);
+    };
+
+    auto finish = [&changes](QSqlDatabase *db) -> std::optional<QString> {
+        if (!DataStore::DbUpdateDirFingerprintsReqTransaction(*db, changes.listed,
+                                                              changes.removed))
+            return "failed to update dir_fingerprints";
+        return {};
+    };
+
+    int64_t imported = 0;
+    auto err = RunImportPipeline(parent, source, InsertScannedFolders, journal->id,
+                                 &imported, finish);
+    return ImportResultMessage(
+        err, *journal, imported,
+        QString("Import complete: %1 new folders imported, %2 folders rescanned")
+            .arg(imported)
+            .arg(changes.listed.size()));
+}
 
-        int64_t next_fid = *count + 1;
-        for (const auto &folder : discovered_folders) {
-            int64_t fid = next_fid++;
-
-            if (!DataStore::DbInsert(
-                    *db, schema::ImageFolders{
-                             .fid = fid,
-                             .folder_path = folder.folder.absolutePath(),
-                             .title = folder.folder.dirName(),
-                             .record_time = folder.record_time.currentSecsSinceEpoch(),
-                             .eh_gid = ""})) {
-                ret = "Error: failed to insert to db";
-                return false;
-            }
+std::optional<QString> DataImporter::UpdateFolders(const QStringList &dirs,
+                                                   FolderUpdate *update,
+                                                   const std::atomic<bool> *cancelled) {
+    auto is_cancelled = [cancelled] { return cancelled && *cancelled; };
+    // no thumbnails yet, the folders of a whole new root are fine to hold
+    std::vector<FolderData> folders;
+    ScanChanges changes;
+    for (const QString &dir : dirs) {
+        auto err = ScanFolder(QDir(dir), false,
+                              [&folders, &is_cancelled](FolderData folder) {
+                                  folders.push_back(std::move(folder));
+                                  return !is_cancelled();
+                              },
+                              &changes);
+        if (err)
+            return err;
+    }
 
-            if (!DataStore::DbInsert(*db,
-                                     schema::CoverImages{
-                                         .fid = fid,
-                                         .cover_fname = folder.cover_fname,
-                                         .cover_base64 = (folder.thumb_base64.size() == 0
-                                                              ? kNoImageBase64
-                                                              : folder.thumb_base64),
-                                     })) {
-                ret = "Error: failed to insert to db";
-                return false;
-            }
+    // Thumbnails are made and committed a batch at a time. The fingerprints are
+    // written last, so an interrupted update lists the same folders again next time
+    // and skips the ones already committed.
+    for (size_t begin = 0; begin < folders.size(); begin += kWriteBatchSize) {
+        if (is_cancelled())
+            return "User cancelled";
+        std::vector<FolderData> batch(
+            std::make_move_iterator(folders.begin() + begin),
+            std::make_move_iterator(folders.begin() +
+                                    std::min(begin + kWriteBatchSize, folders.size())));
+        QtConcurrent::blockingMap(batch, [](FolderData &folder) {
+            if (!folder.cover_fname.isEmpty())
+                folder.thumbnail =
+                    GenerateImgThumbnail(folder.folder.filePath(folder.cover_fname));
+            if (folder.thumbnail.isEmpty())
+                folder.thumbnail = kNoImage;
+        });
+        std::optional<QString> error;
+        auto transaction_err = DataStore::DbTransaction([&](QSqlDatabase *db) {
+            error = InsertScannedFolders(db, batch);
+            return !error;
+        });
+        if (transaction_err)
+            return transaction_err;
+        if (error)
+            return error;
+        update->added += batch.size();
+    }
+
+    std::optional<QString> error;
+    auto transaction_err = DataStore::DbTransaction([&](QSqlDatabase *db) {
+        auto removed = DataStore::DbDeleteFoldersReqTransaction(*db, changes.removed);
+        if (!removed) {
+            error = "failed to delete from img_folders";
+            return false;
         }
-        ret = QString("Import complete: %1 new folders imported")
-                  .arg(discovered_folders.size());
+        if (!DataStore::DbUpdateDirFingerprintsReqTransaction(*db, changes.listed,
+                                                              changes.removed)) {
+            error = "failed to update dir_fingerprints";
+            return false;
+        }
+        update->removed = *removed;
         return true;
     });
-
-    if (transaction_msg) {
-        return QString("Error: %1").arg(*transaction_msg);
-    } else {
-        return ret;
-    }
+    if (transaction_err)
+        return transaction_err;
+    return error;
 }
 
 void DataImporter::SelectThumbnailInFolder(QString dir, QString *filename_out,
@@ -242,158 +577,131 @@ QString DataImporter::ImportEhViewerBackup(QStringList db_files, QDir download_d
         return "invalid download dir";
     }
 
-    // load all ehviewer db entries
-    QMap<int64_t, schema::EhBackupImport> ehv_entries;
-    for (const QString &db_file : qAsConst(db_files)) {
-        QString fault_message = "";
-        {
-            std::optional<QSqlDatabase> ehdb =
-                DataStore::OpenDatabase(db_file, "ehviewer-db-import");
-            if (!ehdb) {
-                return "failed to open eh db file";
-            }
-
-            // read from backup
-            const auto ehdb_data = DataStore::EhBakDbImport(&*ehdb);
-            if (!ehdb_data) {
-                fault_message = "Error: failed to read ehviewer database";
-            } else {
-                for (const schema::EhBackupImport &entry : *ehdb_data) {
-                    ehv_entries.insert(entry.gid, entry);
-                }
-            }
-            ehdb->close();
-        }
-        QSqlDatabase::removeDatabase("ehviewer-db-import");
-        if (!fault_message.isEmpty())
-            return fault_message;
+    std::optional<schema::ImportJournal> journal;
+    // the same backup into the same folder is the same import, whatever the file order
+    {
+        auto db = DataStore::OpenDatabase();
+        if (!db)
+            return "Error: failed to open database";
+        QStringList sorted_db_files = db_files;
+        sorted_db_files.sort();
+        journal = DataStore::DbBeginImport(
+            *db, "ehviewer_backup",
+            sorted_db_files.join('\n') + "\n" + download_dir.absolutePath());
     }
-
-    QString ret;
-    auto transaction_err = DataStore::DbTransaction(
-        [parent, &ret, &ehv_entries, download_dir](QSqlDatabase *db) -> bool {
-            // progress dialog
-            QProgressDialog progress("", "Abort", 0, 0, parent);
-            auto label = new QLabel();
-            label->setAlignment(Qt::AlignLeft);
-            progress.setLabel(label);
-
-            progress.setMinimumDuration(0);
-            progress.setMinimumWidth(500);
-            progress.setModal(Qt::WindowModal);
-            progress.setValue(0);
-            progress.setLabelText("Importing backup");
-            QApplication::processEvents();
-
-            // filter out records if it's already in db
-            auto db_folders = DataStore::DbListAllFolders(*db);
-            if (!db_folders) {
-                ret = "Error: DbListAllFolders() failed";
-                return false;
-            }
-            std::vector<schema::EhBackupImport> new_entries;
-            for (const schema::EhBackupImport &eh_data : qAsConst(ehv_entries)) {
-                QDir dir{download_dir.filePath(QString::fromStdString(eh_data.dirname))};
-                if (!db_folders->contains(dir.absolutePath()))
-                    new_entries.push_back(eh_data);
-            }
-            progress.setMaximum(new_entries.size());
-            progress.setValue(0);
-
-            // insert to db
-            auto count = DataStore::DbMaxFid(*db);
-            if (!count) {
-                qCritical() << "failed to query max fid from main db";
-                ret = "Error: database err";
-                return false;
+    if (!journal)
+        return "Error: failed to read import_journal";
+
+    // the backups are streamed, only a batch of entries is held at a time
+    auto source = [db_files,
+                   download_dir](const FolderSink &sink) -> std::optional<QString> {
+        EhBackupReader reader{db_files};
+        if (auto err = reader.open())
+            return *err;
+
+        std::vector<schema::EhBackupImport> pending;
+        // filter out records if it's already in db, folders of an interrupted run included
+        auto flush = [&pending, &download_dir, &sink]() -> std::optional<QString> {
+            QStringList paths;
+            for (const schema::EhBackupImport &eh_data : pending)
+                paths << QDir{download_dir.filePath(eh_data.dirname)}.absolutePath();
+            std::optional<QSet<QString>> existing;
+            {
+                auto db = DataStore::OpenReadConnection();
+                if (db)
+                    existing = DataStore::DbListExistingFolders(*db, paths);
             }
+            if (!existing)
+                return "failed to read img_folders";
+
+            for (int i = 0; i < paths.size(); i++) {
+                if (existing->contains(paths[i]))
+                    continue;
+                QDir dir{paths[i]};
+                if (!dir.exists())
+                    return QString("Dir %1 not exists").arg(pending[i].dirname);
 
-            int64_t next_fid = *count + 1;
-            int64_t processed = 0;
-            for (schema::EhBackupImport &eh_data : new_entries) {
-                if (progress.wasCanceled()) {
-                    ret = "Error: user cancelled";
-                    return false;
-                }
-
-                QDir dir{download_dir.filePath(QString::fromStdString(eh_data.dirname))};
-                if (!dir.exists()) {
-                    ret = QString("Dir %1 not exists")
-                              .arg(QString::fromStdString(eh_data.dirname));
-                    return false;
-                }
-
-                // generate thumbnail
                 QString filename;
                 QString filepath;
-                QString thumb_base64;
                 SelectThumbnailInFolder(dir.absolutePath(), &filename, &filepath);
-                if (!filename.isEmpty()) {
-                    thumb_base64 = DataImporter::GenerateImgThumbnail(filepath);
-                }
-                if (thumb_base64.isEmpty())
-                    thumb_base64 = kNoImageBase64;
-
-                // insert img_folder
-                qlonglong this_fid = next_fid++;
-
-                std::string title =
-                    eh_data.title_jpn.empty() ? eh_data.title : eh_data.title_jpn;
-                if (!DataStore::DbInsert(*db,
-                                         schema::ImageFolders{
-                                             .fid = this_fid,
-                                             .folder_path = dir.absolutePath(),
-                                             .title = QString::fromStdString(title),
-                                             .record_time = EhViewerTimeToStamp(
-                                                 QString::fromStdString(eh_data.posted)),
-                                             .eh_gid = QString::number(eh_data.gid),
-                                         })) {
-                    ret = "failed to insert to img_folders";
-                    return false;
-                }
-
-                if (!DataStore::DbInsert(
-                        *db, schema::CoverImages{.fid = this_fid,
-                                                 .cover_fname = filename,
-                                                 .cover_base64 = thumb_base64})) {
-                    ret = "failed to insert to cover_images";
-                    return false;
-                }
-
-                if (!DataStore::DbInsert(
-                        *db, schema::EhentaiMetadata{
-                                 .gid = QString::number(eh_data.gid),
-                                 .token = QString::fromStdString(eh_data.token),
-                                 .title = QString::fromStdString(eh_data.title),
-                                 .title_jpn = QString::fromStdString(eh_data.title_jpn),
-                                 .category = eh_data.category,
-                                 .thumb = QString::fromStdString(eh_data.thumb),
-                                 .uploader = QString::fromStdString(eh_data.uploader),
-                                 .posted = EhViewerTimeToStamp(
-                                     QString::fromStdString(eh_data.posted)),
-                                 .filecount = 0,
-                                 .filesize = 0,
-                                 .expunged = -1,
-                                 .rating = eh_data.rating,
-                                 .meta_updated = 0,
-                             })) {
-                    ret = "failed to insert to ehentai_metadata";
-                    return false;
-                }
-
-                progress.setLabelText(
-                    QString("Importing: %1").arg(QString::fromStdString(title)));
-                progress.setValue(++processed);
+                if (!sink({.folder = dir,
+                           .cover_fname = filename,
+                           .thumbnail = {},
+                           .record_time = {},
+                           .eh_data = std::move(pending[i]),
+                           .cover = {}}))
+                    return "user cancelled";
+            }
+            pending.clear();
+            return {};
+        };
+
+        while (auto eh_data = reader.next()) {
+            pending.push_back(std::move(*eh_data));
+            if (pending.size() >= kBackupLookupBatch) {
+                if (auto err = flush())
+                    return err;
             }
+        }
+        if (auto err = reader.error())
+            return *err;
+        return flush();
+    };
 
-            ret = QString("Import complete: %1 new folders are imported")
-                      .arg(new_entries.size());
-            return true;
-        });
+    auto writer = [](QSqlDatabase *db,
+                     const std::vector<FolderData> &batch) -> std::optional<QString> {
+        auto count = DataStore::DbMaxFid(*db);
+        if (!count) {
+            qCritical() << "failed to query max fid from main db";
+            return "database err";
+        }
 
-    if (transaction_err) {
-        return QString("Error: %1").arg(*transaction_err);
-    } else {
-        return ret;
-    }
+        int64_t next_fid = *count + 1;
+        std::vector<schema::ImageFolders> folders;
+        std::vector<schema::CoverImages> covers;
+        std::vector<schema::EhentaiMetadata> metadata;
+        for (const FolderData &folder : batch) {
+            const schema::EhBackupImport &eh_data = *folder.eh_data;
+            qlonglong this_fid = next_fid++;
+
+            folders.push_back({
+                .fid = this_fid,
+                .folder_path = folder.folder.absolutePath(),
+                .title = eh_data.title_jpn.isEmpty() ? eh_data.title : eh_data.title_jpn,
+                .record_time = EhViewerTimeToStamp(eh_data.posted),
+                .eh_gid = QString::number(eh_data.gid),
+            });
+            covers.push_back({.fid = this_fid,
+                              .cover_fname = folder.cover_fname,
+                              .cover = folder.thumbnail});
+            metadata.push_back({
+                .gid = QString::number(eh_data.gid),
+                .token = eh_data.token,
+                .title = eh_data.title,
+                .title_jpn = eh_data.title_jpn,
+                .category = eh_data.category,
+                .thumb = eh_data.thumb,
+                .uploader = eh_data.uploader,
+                .posted = EhViewerTimeToStamp(eh_data.posted),
+                .filecount = 0,
+                .filesize = 0,
+                .expunged = -1,
+                .rating = eh_data.rating,
+                .meta_updated = 0,
+            });
+        }
+        if (!DataStore::DbBulkInsert(*db, folders))
+            return "failed to insert to img_folders";
+        if (!DataStore::DbBulkInsert(*db, covers))
+            return "failed to insert to cover_images";
+        if (!DataStore::DbBulkInsert(*db, metadata))
+            return "failed to insert to ehentai_metadata";
+        return {};
+    };
+
+    int64_t imported = 0;
+    auto err = RunImportPipeline(parent, source, writer, journal->id, &imported);
+    return ImportResultMessage(
+        err, *journal, imported,
+        QString("Import complete: %1 new folders are imported").arg(imported));
 }
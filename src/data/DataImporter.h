@@ -3,37 +3,105 @@
 
 #include <QDateTime>
 #include <QDir>
+#include <QImage>
 #include <QProgressDialog>
 #include <QString>
 #include <QStringList>
+#include <QtSql>
 
+#include <atomic>
+#include <functional>
 #include <optional>
 #include <vector>
 
+#include "DatabaseSchema.h"
+
 class DataImporter {
   public:
-    static const QString kNoImageBase64;
-    // return empty string if fail
-    static QString GenerateImgThumbnail(const QString &file_path);
+    // thumbnail used when a folder has no usable image
+    static const QByteArray kNoImage;
+    // return jpeg file content, or empty array if fail
+    static QByteArray GenerateImgThumbnail(const QString &file_path);
+    // The two halves of GenerateImgThumbnail(), run by different pipeline stages.
+    // Decodes at reduced resolution when the format allows it, see QImageReader.
+    // return a null image if fail
+    static QImage LoadScaledImage(const QString &file_path);
+    // return empty array if fail
+    static QByteArray EncodeThumbnail(QImage image);
 
     // Import may success or fail. Return the final message
-    static QString ImportDir(QDir dir, QWidget *parent);
+    // Folders whose fingerprint didn't change since the last import of dir are not
+    // listed again, unless full_rescan.
+    static QString ImportDir(QDir dir, QWidget *parent, bool full_rescan = false);
     static QString ImportEhViewerBackup(QStringList db_files, QDir download_dir,
                                         QWidget *parent);
 
+    struct FolderUpdate {
+        int64_t added = 0;
+        int64_t removed = 0;
+    };
+    // Bring the given folders of the library up to date without any UI: import the
+    // new image folders below them and delete the ones that vanished. Only folders
+    // whose fingerprint changed are listed. New folders are committed in batches,
+    // setting *cancelled stops after the current one. Blocks, can run on any thread.
+    // Return a string if any errors occur.
+    static std::optional<QString>
+    UpdateFolders(const QStringList &dirs, FolderUpdate *update,
+                  const std::atomic<bool> *cancelled = nullptr);
+
   protected:
     struct FolderData {
         QDir folder;
         QString cover_fname;
-        QString thumb_base64;
+        QByteArray thumbnail;
         QDateTime record_time;
+        // set when importing an EhViewer backup
+        std::optional<schema::EhBackupImport> eh_data;
+        // decoded and scaled cover, passed from the decode to the encode stage
+        QImage cover;
     };
+    // returns false once the import is cancelled, thread safe
+    using FolderSink = std::function<bool(FolderData folder)>;
+    // Finds the folders to import and passes them to the sink, runs on the scan thread.
+    // Return a string if any errors occur.
+    using FolderSource = std::function<std::optional<QString>(const FolderSink &sink)>;
+    // Inserts folders whose thumbnail is ready, runs on the writer thread inside the
+    // import transaction. Return a string if any errors occur.
+    using FolderWriter = std::function<std::optional<QString>(
+        QSqlDatabase *db, const std::vector<FolderData> &batch)>;
+    // Runs on the writer thread once every folder is written, in the transaction that
+    // marks the import finished.
+    using ImportFinisher = std::function<std::optional<QString>(QSqlDatabase *db)>;
+
+    // Staged import: source -> decode & scale -> jpeg encode -> writer.
+    // Every stage has its own threads, the decode and encode stages share the cores.
+    // Stages are connected by bounded queues, a full queue blocks the stage feeding it.
+    // The single writer commits every batch in its own transaction, together with the
+    // progress of the run `journal_id` in import_journal. A failed or cancelled import
+    // keeps the folders committed so far, the source should skip them when the import
+    // is resumed.
+    // Shows a progress dialog until finished. Return a string if any errors occur.
+    static std::optional<QString> RunImportPipeline(QWidget *parent, FolderSource source,
+                                                    FolderWriter writer,
+                                                    int64_t journal_id,
+                                                    int64_t *written_count,
+                                                    ImportFinisher finish = {});
 
-    // Scan dir, add all image dirs into output_list, also update progress.label
+    // folder fingerprints to store once the scanned folders are imported
+    struct ScanChanges {
+        std::vector<schema::DirFingerprints> listed;
+        QStringList removed;
+    };
+    // Scan dir with a DirWalker, pass the image dirs that are not in img_folders yet
+    // to the sink. Folders whose fingerprint in dir_fingerprints is unchanged are not
+    // listed, nor passed to the sink, unless full_rescan.
     // Return a string if any errors occur.
-    static std::optional<QString> ScanFolder(const QDir &dir,
-                                             std::vector<FolderData> *output_list,
-                                             QProgressDialog *progress);
+    static std::optional<QString> ScanFolder(const QDir &dir, bool full_rescan,
+                                             const FolderSink &sink,
+                                             ScanChanges *changes);
+    // FolderWriter of scanned folders
+    static std::optional<QString>
+    InsertScannedFolders(QSqlDatabase *db, const std::vector<FolderData> &batch);
     static void SelectThumbnailInFolder(QString dir, QString *filename_out,
                                         QString *filepath_out);
 };
@@ -1,14 +1,27 @@
 #include "DataStore.h"
 
+#include <QCoreApplication>
 #include <QDebug>
 #include <QElapsedTimer>
 #include <QFileInfo>
-#include <QRegExp>
+#include <QRecursiveMutex>
+#include <QSemaphore>
+#include <QThread>
+#include <QtConcurrent>
 #include <QtSql>
+#include <atomic>
+#include <map>
 #include <optional>
-#include <unordered_set>
+#include <type_traits>
 
 #include "DatabaseSchema.h"
+#include "ImageHash.h"
+#include "ParallelFilter.h"
+#include "PostingList.h"
+#include "SchemaCodec.h"
+#include "SearchIndex.h"
+#include "SearchTerm.h"
+#include "src/DuplicateClusterer.h"
 #include "src/FuzzSearcher.h"
 
 using std::optional;
@@ -33,11 +46,29 @@ QString DataStore::GetSqlitePath() {
     return GetSettings().value("core/db_path").toString();
 }
 
-std::optional<QSqlDatabase> DataStore::OpenDatabase(QString connection_name) {
+SearchIndex &DataStore::GetSearchIndex() {
+    static SearchIndex index;
+    return index;
+}
+
+QString DataStore::ThreadConnectionName() {
+    QThread *thread = QThread::currentThread();
+    if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+        return kDefaultConnectionName;
+    // not the QThread address, which a later thread may reuse while the connections of
+    // the dead one are still registered
+    static std::atomic<quint64> last_thread_id{0};
+    thread_local const quint64 thread_id = ++last_thread_id;
+    return QString("db-conn-thread-%1").arg(thread_id);
+}
+
+namespace {
+std::optional<QSqlDatabase> OpenPooledConnection(const QString &connection_name,
+                                                 bool read_only) {
     if (QSqlDatabase::contains(connection_name)) {
         return QSqlDatabase::database(connection_name);
     } else {
-        QString db_path = GetSqlitePath();
+        QString db_path = DataStore::GetSqlitePath();
         if (db_path.size() <= 0) {
             qCritical() << "Invalid db_path";
             return {};
@@ -52,10 +83,89 @@ std::optional<QSqlDatabase> DataStore::OpenDatabase(QString connection_name) {
             qCritical() << "failed to open database";
             return {};
         }
+        if (!DataStore::ConfigureConnection(db, read_only)) {
+            db.close();
+            QSqlDatabase::removeDatabase(connection_name);
+            return {};
+        }
         return db;
     }
 }
 
+// The search index mirrors the application's db, which is only written through the
+// pooled connections (see ThreadConnectionName()). Other files opened with
+// OpenDatabase(db_path, conn_name), e.g. by a benchmark, must not touch it.
+bool TracksSearchIndex(const QSqlDatabase &db) {
+    return db.connectionName().startsWith("db-conn-");
+}
+} // namespace
+
+std::optional<QSqlDatabase> DataStore::OpenDatabase(QString connection_name) {
+    if (connection_name.isNull())
+        connection_name = ThreadConnectionName();
+    return OpenPooledConnection(connection_name, false);
+}
+
+std::optional<QSqlDatabase> DataStore::OpenReadConnection() {
+    return OpenPooledConnection(ThreadConnectionName() + "-ro", true);
+}
+
+void DataStore::CloseThreadConnections() {
+    QString name = ThreadConnectionName();
+    for (const QString &connection_name : QStringList{name, name + "-ro"}) {
+        if (QSqlDatabase::contains(connection_name))
+            QSqlDatabase::removeDatabase(connection_name);
+    }
+}
+
+void DataStore::ClosePoolConnections(QThreadPool &pool) {
+    // one task per thread: each one holds its thread until all of them have started
+    const int threads = pool.maxThreadCount();
+    QSemaphore started;
+    QSemaphore release;
+    for (int i = 0; i < threads; i++) {
+        QtConcurrent::run(&pool, [&started, &release] {
+            CloseThreadConnections();
+            started.release();
+            release.acquire();
+        });
+    }
+    started.acquire(threads);
+    release.release(threads);
+    pool.waitForDone();
+}
+
+bool DataStore::ConfigureConnection(QSqlDatabase &db, bool read_only) {
+    QStringList pragmas = {
+        "PRAGMA busy_timeout = 10000",  // ms, wait for the writer instead of failing
+        "PRAGMA synchronous = NORMAL",  // safe with WAL, only durability is relaxed
+        "PRAGMA cache_size = -65536",   // KiB, per connection
+        "PRAGMA mmap_size = 268435456", // 256 MiB
+    };
+    if (read_only) {
+        // not SQLITE_OPEN_READONLY, which can't create the -shm file of a WAL db
+        pragmas << "PRAGMA query_only = ON";
+    }
+    QSqlQuery query{db};
+    if (!read_only) {
+        // persistent, readers opened later pick it up from the db file
+        if (!query.exec("PRAGMA journal_mode = WAL") || !query.next()) {
+            qCritical() << query.lastError();
+            return false;
+        }
+        if (query.value(0).toString().compare("wal", Qt::CaseInsensitive) != 0)
+            qWarning() << "WAL mode not available, journal mode is" << query.value(0);
+        query.finish();
+    }
+    for (const QString &sql : qAsConst(pragmas)) {
+        if (!query.exec(sql)) {
+            qCritical() << sql << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
 std::optional<QSqlDatabase> DataStore::OpenDatabase(QString db_path, QString conn_name) {
     if (QSqlDatabase::contains(conn_name)) {
         QSqlDatabase::removeDatabase(conn_name);
@@ -79,76 +189,482 @@ std::optional<QSqlDatabase> DataStore::OpenDatabase(QString db_path, QString con
 
 namespace {
 
-// returns false if table creation failed.
-template <typename Schema> bool CreateTable(QSqlDatabase &db) {
+// Cleared when search_fts can't be created or queried, DbSearch() then falls back to
+// regex matching for every term.
+std::atomic<bool> fts_enabled{false};
+
+template <typename Schema, typename = void>
+struct HasPostCreationSql : std::false_type {};
+template <typename Schema>
+struct HasPostCreationSql<Schema, std::void_t<decltype(Schema::PostCreationSql())>>
+    : std::true_type {};
+
+template <typename Schema, typename = void> struct HasMigrationSql : std::false_type {};
+template <typename Schema>
+struct HasMigrationSql<Schema, std::void_t<decltype(Schema::MigrationSql(1))>>
+    : std::true_type {};
+
+// Run statements one by one, return false if any of them fails.
+bool ExecAll(QSqlDatabase &db, const QStringList &statements, const QString &what) {
+    for (const QString &sql : statements) {
+        auto result = db.exec(sql);
+        if (result.lastError().type() != QSqlError::NoError) {
+            qCritical() << what << result.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Revision recorded in table_revision, 0 if the table doesn't exist, {} if error.
+std::optional<int64_t> StoredRevision(QSqlDatabase &db, const QString &table_name) {
     QSqlQuery query{db};
     if (!query.prepare("SELECT revision FROM table_revision WHERE table_name=?")) {
         qCritical() << query.lastError();
+        return {};
+    }
+    query.addBindValue(table_name);
+    if (!query.exec()) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    if (!query.isActive()) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    if (!query.first())
+        return 0;
+
+    QVariant v = query.value(0);
+    if (!v.canConvert(QMetaType::LongLong)) {
+        qCritical() << "Invalid table revision value:" << v;
+        return {};
+    }
+    return v.toLongLong();
+}
+
+bool SetStoredRevision(QSqlDatabase &db, const QString &table_name, int64_t revision) {
+    QSqlQuery query{db};
+    if (!query.prepare(
+            "INSERT OR REPLACE INTO table_revision(table_name, revision) VALUES(?,?)")) {
+        qCritical() << query.lastError();
         return false;
     }
-    query.addBindValue(Schema::TableName());
+    query.addBindValue(table_name);
+    query.addBindValue(qlonglong(revision));
     if (!query.exec()) {
         qCritical() << query.lastError();
         return false;
     }
-    if (!query.isActive()) {
+    return true;
+}
+
+// Create the table at revision 1 if it doesn't exist, MigrateTable() brings it up
+// to date. returns false if table creation failed.
+template <typename Schema> bool CreateTable(QSqlDatabase &db) {
+    auto rev = StoredRevision(db, Schema::TableName());
+    if (!rev)
+        return false;
+    if (*rev > 0)
+        return true;
+
+    auto result = db.exec(Schema::CreationSql());
+    if (result.lastError().type() != QSqlError::NoError) {
+        qCritical() << "Failed to create table" << Schema::TableName()
+                    << result.lastError();
+        return false;
+    }
+    if constexpr (HasPostCreationSql<Schema>::value) {
+        if (!ExecAll(db, Schema::PostCreationSql(),
+                     "Failed to set up table " + Schema::TableName()))
+            return false;
+    }
+    if (!SetStoredRevision(db, Schema::TableName(), 1))
+        return false;
+    qInfo() << "Created table" << Schema::TableName();
+    return true;
+}
+
+template <> bool CreateTable<schema::TableRevision>(QSqlDatabase &db) {
+    auto result = db.exec(schema::TableRevision::CreationSql());
+    if (result.lastError().type() != QSqlError::NoError) {
+        qCritical() << "Failed to create table" << schema::TableRevision::TableName()
+                    << result.lastError();
+        return false;
+    } else {
+        qInfo() << "Created table" << schema::TableRevision::TableName();
+        return true;
+    }
+}
+
+// Upgrade the table from revision `from` to `from + 1`.
+// Specialize this for steps that can't be expressed in sql.
+template <typename Schema> bool MigrateStep(QSqlDatabase &db, int64_t from) {
+    if constexpr (HasMigrationSql<Schema>::value) {
+        std::optional<QStringList> statements = Schema::MigrationSql(from);
+        if (!statements) {
+            qCritical() << "No migration defined for table" << Schema::TableName()
+                        << "from revision" << from;
+            return false;
+        }
+        return ExecAll(db, *statements,
+                       QString("Failed to migrate table %1 from revision %2")
+                           .arg(Schema::TableName())
+                           .arg(from));
+    } else {
+        qCritical() << "No migration defined for table" << Schema::TableName();
+        return false;
+    }
+}
+
+// The title_norms row of a folder. Computed here, sqlite can't normalize unicode.
+schema::TitleNorms MakeTitleNorms(int64_t fid, const QString &title) {
+    return {.fid = fid,
+            .title = title,
+            .normalized = FuzzSearcher::NormalizeTitle(title)};
+}
+
+bool UpsertTitleNorms(QSqlDatabase &db, const std::vector<schema::TitleNorms> &rows) {
+    QSqlQuery query{db};
+    if (!query.prepare(schema::InsertSql<schema::TitleNorms>("INSERT OR REPLACE"))) {
         qCritical() << query.lastError();
         return false;
     }
+    for (const schema::TitleNorms &row : rows) {
+        schema::BindRow(&query, row);
+        if (!query.exec()) {
+            qCritical() << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+// title_norms 1 -> 2: normalize the titles of the folders already in img_folders.
+bool FillTitleNorms(QSqlDatabase &db) {
+    QSqlQuery select{db};
+    select.setForwardOnly(true);
+    if (!select.exec("SELECT fid, title FROM img_folders")) {
+        qCritical() << select.lastError();
+        return false;
+    }
+    std::vector<schema::TitleNorms> rows;
+    int64_t filled = 0;
+    while (select.next()) {
+        rows.push_back(
+            MakeTitleNorms(select.value(0).toLongLong(), select.value(1).toString()));
+        if (rows.size() >= 1000) {
+            if (!UpsertTitleNorms(db, rows))
+                return false;
+            filled += rows.size();
+            rows.clear();
+        }
+    }
+    if (!UpsertTitleNorms(db, rows))
+        return false;
+    filled += rows.size();
+    qInfo() << "Normalized" << filled << "titles";
+    return true;
+}
 
-    if (!query.first()) {
-        auto result = db.exec(Schema::CreationSql());
-        if (result.lastError().type() != QSqlError::NoError) {
-            qCritical() << "Failed to create table" << Schema::TableName()
-                        << result.lastError();
+template <> bool MigrateStep<schema::TitleNorms>(QSqlDatabase &db, int64_t from) {
+    switch (from) {
+    case 1:
+        return FillTitleNorms(db);
+    default:
+        qCritical() << "No migration defined for title_norms from revision" << from;
+        return false;
+    }
+}
+
+// Add the fids of `rows` to the title_grams postings of their trigrams.
+bool IndexTitleGrams(QSqlDatabase &db, const std::vector<schema::TitleNorms> &rows) {
+    // ordered, the postings are then written in primary key order
+    std::map<int64_t, std::vector<int64_t>> added;
+    for (const schema::TitleNorms &row : rows) {
+        for (int64_t gram : FuzzSearcher::TitleGrams(row.normalized))
+            added[gram].push_back(row.fid);
+    }
+    QSqlQuery select{db};
+    QSqlQuery upsert{db};
+    if (!select.prepare("SELECT fids FROM title_grams WHERE gram = ?") ||
+        !upsert.prepare(schema::InsertSql<schema::TitleGrams>("INSERT OR REPLACE"))) {
+        qCritical() << select.lastError() << upsert.lastError();
+        return false;
+    }
+    for (auto &[gram, fids] : added) {
+        std::sort(fids.begin(), fids.end());
+        fids.erase(std::unique(fids.begin(), fids.end()), fids.end());
+        select.bindValue(0, qlonglong(gram));
+        if (!select.exec()) {
+            qCritical() << select.lastError();
+            return false;
+        }
+        if (select.next())
+            fids = PostingList::Merge(PostingList::Decode(select.value(0).toByteArray()),
+                                      fids);
+        select.finish();
+        schema::BindRow(&upsert, schema::TitleGrams{gram, PostingList::Encode(fids)});
+        if (!upsert.exec()) {
+            qCritical() << upsert.lastError();
             return false;
         }
+    }
+    return true;
+}
+
+// title_grams 1 -> 2: index the title_norms rows already there.
+bool FillTitleGrams(QSqlDatabase &db) {
+    QSqlQuery select{db};
+    select.setForwardOnly(true);
+    if (!select.exec(schema::SelectSql<schema::TitleNorms>())) {
+        qCritical() << select.lastError();
+        return false;
+    }
+    // large batches, every batch rewrites the postings of the common trigrams
+    std::vector<schema::TitleNorms> rows;
+    int64_t indexed = 0;
+    while (select.next()) {
+        rows.push_back(schema::ReadRow<schema::TitleNorms>(select));
+        if (rows.size() >= 20000) {
+            if (!IndexTitleGrams(db, rows))
+                return false;
+            indexed += rows.size();
+            rows.clear();
+        }
+    }
+    if (!IndexTitleGrams(db, rows))
+        return false;
+    indexed += rows.size();
+    qInfo() << "Indexed the trigrams of" << indexed << "titles";
+    return true;
+}
 
-        QSqlQuery ins{db};
-        if (!ins.prepare(
-                "INSERT INTO table_revision(table_name, revision) VALUES(?,?)")) {
-            qCritical() << ins.lastError();
+template <> bool MigrateStep<schema::TitleGrams>(QSqlDatabase &db, int64_t from) {
+    switch (from) {
+    case 1:
+        return FillTitleGrams(db);
+    default:
+        qCritical() << "No migration defined for title_grams from revision" << from;
+        return false;
+    }
+}
+
+// cover_hashes rows of the covers that can be decoded, decoded on the global thread pool
+QVector<schema::CoverHashes> HashCovers(const std::vector<schema::CoverImages> &covers) {
+    auto hash_chunk = [&covers](size_t begin, size_t end,
+                                QVector<schema::CoverHashes> *out) {
+        for (size_t i = begin; i < end; i++) {
+            auto dhash = ImageHash::DHash(covers[i].cover);
+            if (!dhash) {
+                qWarning() << "can't decode the cover of fid=" << covers[i].fid;
+                continue;
+            }
+            *out << schema::CoverHashes{.fid = covers[i].fid,
+                                        .dhash = int64_t(*dhash),
+                                        .block0 = int64_t(*dhash & 0xffff),
+                                        .block1 = int64_t(*dhash >> 16 & 0xffff),
+                                        .block2 = int64_t(*dhash >> 32 & 0xffff),
+                                        .block3 = int64_t(*dhash >> 48)};
+        }
+    };
+    // a decode costs far more than a keyword match, small chunks pay off
+    return ParallelFilter<schema::CoverHashes>(covers.size(), hash_chunk, 16);
+}
+
+bool UpsertCoverHashes(QSqlDatabase &db, const QVector<schema::CoverHashes> &rows) {
+    QSqlQuery query{db};
+    if (!query.prepare(schema::InsertSql<schema::CoverHashes>("INSERT OR REPLACE"))) {
+        qCritical() << query.lastError();
+        return false;
+    }
+    for (const schema::CoverHashes &row : rows) {
+        schema::BindRow(&query, row);
+        if (!query.exec()) {
+            qCritical() << query.lastError();
             return false;
         }
-        ins.addBindValue(Schema::TableName());
-        ins.addBindValue(Schema::SchemaRevision());
-        if (!ins.exec()) {
-            qCritical() << ins.lastError();
+    }
+    return true;
+}
+
+// cover_hashes 1 -> 2: hash the covers already in cover_images.
+bool FillCoverHashes(QSqlDatabase &db) {
+    QSqlQuery select{db};
+    select.setForwardOnly(true);
+    if (!select.exec(schema::SelectSql<schema::CoverImages>())) {
+        qCritical() << select.lastError();
+        return false;
+    }
+    std::vector<schema::CoverImages> covers;
+    int64_t hashed = 0;
+    while (select.next()) {
+        covers.push_back(schema::ReadRow<schema::CoverImages>(select));
+        if (covers.size() >= 1000) {
+            if (!UpsertCoverHashes(db, HashCovers(covers)))
+                return false;
+            hashed += covers.size();
+            covers.clear();
+        }
+    }
+    if (!UpsertCoverHashes(db, HashCovers(covers)))
+        return false;
+    hashed += covers.size();
+    qInfo() << "Hashed" << hashed << "covers";
+    return true;
+}
+
+template <> bool MigrateStep<schema::CoverHashes>(QSqlDatabase &db, int64_t from) {
+    switch (from) {
+    case 1:
+        return FillCoverHashes(db);
+    default:
+        qCritical() << "No migration defined for cover_hashes from revision" << from;
+        return false;
+    }
+}
+
+// cover_images 1 -> 2: decode cover_base64 into a blob column.
+bool MigrateCoverImagesToBlob(QSqlDatabase &db) {
+    const QStringList create = {R"_SQL_(
+        create table cover_images_v2(     -- table about front cover thumbnail
+            fid integer primary key,      -- foreign key for img_folders.fid
+            cover_fname text not null,    -- file name of the cover, as in img_folders[fid].folder_path
+            cover blob not null           -- thumbnail file content
+        )
+        )_SQL_"};
+    if (!ExecAll(db, create, "Failed to create cover_images_v2"))
+        return false;
+
+    QSqlQuery select{db};
+    select.setForwardOnly(true);
+    if (!select.exec("SELECT fid, cover_fname, cover_base64 FROM cover_images")) {
+        qCritical() << select.lastError();
+        return false;
+    }
+    QSqlQuery insert{db};
+    if (!insert.prepare(
+            "INSERT INTO cover_images_v2(fid, cover_fname, cover) VALUES(?,?,?)")) {
+        qCritical() << insert.lastError();
+        return false;
+    }
+    int64_t converted = 0;
+    while (select.next()) {
+        insert.bindValue(0, select.value(0).toLongLong());
+        insert.bindValue(1, select.value(1).toString());
+        insert.bindValue(2,
+                         QByteArray::fromBase64(select.value(2).toString().toLatin1()));
+        if (!insert.exec()) {
+            qCritical() << insert.lastError();
             return false;
         }
-        qInfo() << "Created table" << Schema::TableName();
+        converted++;
+    }
+    qInfo() << "Converted" << converted << "covers to blob";
+
+    // the triggers on cover_images are dropped with it
+    return ExecAll(db,
+                   {"DROP TABLE cover_images",
+                    "ALTER TABLE cover_images_v2 RENAME TO cover_images",
+                    schema::CoverHashes::CoverImagesTriggerSql()},
+                   "Failed to replace cover_images");
+}
+
+template <> bool MigrateStep<schema::CoverImages>(QSqlDatabase &db, int64_t from) {
+    switch (from) {
+    case 1:
+        return MigrateCoverImagesToBlob(db);
+    default:
+        qCritical() << "No migration defined for cover_images from revision" << from;
+        return false;
+    }
+}
+
+// Bring an existing table to Schema::SchemaRevision(), one transaction per revision.
+template <typename Schema>
+bool MigrateTable(QSqlDatabase &db, const DataStore::MigrationProgress &progress) {
+    auto rev = StoredRevision(db, Schema::TableName());
+    if (!rev)
+        return false;
+    if (*rev == 0) // optional table that was not created
         return true;
-    } else {
-        QVariant v = query.value(0);
-        if (!v.canConvert(QMetaType::LongLong)) {
-            qCritical() << "Invalid table revision value:" << v;
+    if (*rev > Schema::SchemaRevision()) {
+        qCritical() << "Table" << Schema::TableName() << "has revision" << *rev
+                    << "which is newer than" << Schema::SchemaRevision();
+        return false;
+    }
+
+    for (int64_t from = *rev; from < Schema::SchemaRevision(); from++) {
+        if (progress)
+            progress(Schema::TableName(), from, from + 1);
+        QElapsedTimer timer;
+        timer.start();
+        if (!db.transaction()) {
+            qCritical() << db.lastError();
             return false;
         }
-        qlonglong rev = v.toLongLong();
-        if (rev == Schema::SchemaRevision()) {
-            return true;
-        } else {
-            qCritical() << "Revision mismatch for table" << Schema::TableName();
+        if (!MigrateStep<Schema>(db, from) ||
+            !SetStoredRevision(db, Schema::TableName(), from + 1)) {
+            db.rollback();
             return false;
         }
+        if (!db.commit()) {
+            qCritical() << db.lastError();
+            db.rollback();
+            return false;
+        }
+        qInfo() << "Migrated table" << Schema::TableName() << "from revision" << from
+                << "to" << from + 1 << "in" << timer.elapsed() << "ms";
     }
+    return true;
 }
 
-template <> bool CreateTable<schema::TableRevision>(QSqlDatabase &db) {
-    auto result = db.exec(schema::TableRevision::CreationSql());
-    if (result.lastError().type() != QSqlError::NoError) {
-        qCritical() << "Failed to create table" << schema::TableRevision::TableName()
-                    << result.lastError();
+// Every column of Schema::Fields() must exist once the table is migrated. A descriptor
+// out of sync with the creation and migration sql fails here, not in the first query.
+template <typename Schema> bool CheckColumns(QSqlDatabase &db) {
+    QSqlQuery query{db};
+    if (!query.exec(QString("PRAGMA table_info(%1)").arg(Schema::TableName()))) {
+        qCritical() << query.lastError();
         return false;
-    } else {
-        qInfo() << "Created table" << schema::TableRevision::TableName();
-        return true;
     }
+    QSet<QString> columns;
+    while (query.next())
+        columns << query.value(1).toString();
+    const QStringList names = schema::ColumnNames<Schema>();
+    for (const QString &name : names) {
+        if (!columns.contains(name)) {
+            qCritical() << "Table" << Schema::TableName() << "has no column" << name;
+            return false;
+        }
+    }
+    return true;
 }
 
+template <typename... Schemas> struct TableList {
+    static bool MigrateAll(QSqlDatabase &db,
+                           const DataStore::MigrationProgress &progress) {
+        return (MigrateTable<Schemas>(db, progress) && ...);
+    }
+    static bool CheckAllColumns(QSqlDatabase &db) {
+        return (CheckColumns<Schemas>(db) && ...);
+    }
+};
+// in dependency order
+using VersionedTables =
+    TableList<schema::ImageFolders, schema::CoverImages, schema::FolderTags,
+              schema::EhentaiMetadata, schema::EhentaiTags, schema::SearchDocs,
+              schema::SearchFts, schema::DirFingerprints, schema::ImportJournal,
+              schema::TitleNorms, schema::TitleGrams, schema::CoverHashes>;
+// tables read and written through SchemaCodec.h
+using CodecTables =
+    TableList<schema::ImageFolders, schema::CoverImages, schema::FolderTags,
+              schema::EhentaiMetadata, schema::EhentaiTags, schema::SearchDocs,
+              schema::DirFingerprints, schema::ImportJournal, schema::TitleNorms,
+              schema::TitleGrams, schema::CoverHashes>;
+
 } // namespace
 
-bool DataStore::DbCreateTables(QSqlDatabase &db) {
+bool DataStore::DbCreateTables(QSqlDatabase &db, const MigrationProgress &progress) {
 #define CREATE_TABLE(sch_class)                                                          \
     do {                                                                                 \
         if (!CreateTable<::schema::sch_class>(db)) {                                     \
@@ -167,13 +683,33 @@ bool DataStore::DbCreateTables(QSqlDatabase &db) {
     CREATE_TABLE(FolderTags);
     CREATE_TABLE(EhentaiMetadata);
     CREATE_TABLE(EhentaiTags);
+    CREATE_TABLE(SearchDocs);
+    CREATE_TABLE(DirFingerprints);
+    CREATE_TABLE(ImportJournal);
+    CREATE_TABLE(TitleNorms);
+    CREATE_TABLE(TitleGrams);
+    CREATE_TABLE(CoverHashes);
+    // Full text search is optional: it needs fts5 and the trigram tokenizer.
+    db.exec("SAVEPOINT create_fts");
+    fts_enabled = CreateTable<schema::SearchFts>(db);
+    if (fts_enabled) {
+        db.exec("RELEASE create_fts");
+    } else {
+        qWarning() << "Full text search not available, substring search will be slower";
+        db.exec("ROLLBACK TO create_fts");
+        db.exec("RELEASE create_fts");
+    }
     if (!db.commit()) {
         qCritical() << db.lastError();
         db.rollback();
         return false;
     }
-    return true;
 #undef CREATE_TABLE
+
+    // new tables are created at revision 1 and go through the same steps
+    if (!VersionedTables::MigrateAll(db, progress))
+        return false;
+    return CodecTables::CheckAllColumns(db);
 }
 
 std::optional<int64_t> DataStore::DbMaxFid(QSqlDatabase &db) {
@@ -203,31 +739,68 @@ std::optional<QSet<QString>> DataStore::DbListAllFolders(QSqlDatabase &db) {
     return ret;
 }
 
-std::optional<QList<schema::FolderPreview>>
+std::optional<QList<schema::DirFingerprints>>
+DataStore::DbListDirFingerprints(QSqlDatabase &db, const QString &root) {
+    QList<schema::DirFingerprints> ret;
+    QSqlQuery query{db};
+    query.setForwardOnly(true);
+    // '0' sorts right after '/', so the range covers everything below root
+    if (!query.prepare(schema::SelectSql<schema::DirFingerprints>() +
+                       " WHERE path = ? OR (path > ? || '/' AND path < ? || '0')")) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    query.addBindValue(root);
+    query.addBindValue(root);
+    query.addBindValue(root);
+    if (!query.exec()) {
+        qCritical() << "select dir_fingerprints failed" << query.lastError();
+        return {};
+    }
+    while (query.next())
+        ret << schema::ReadRow<schema::DirFingerprints>(query);
+    return ret;
+}
+
+std::optional<QSet<QString>> DataStore::DbListExistingFolders(QSqlDatabase &db,
+                                                              const QStringList &paths) {
+    QSet<QString> ret;
+    QSqlQuery query{db};
+    // one lookup each in the unique index of folder_path
+    if (!query.prepare("SELECT 1 FROM img_folders WHERE folder_path = ?")) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    for (const QString &path : paths) {
+        query.addBindValue(path);
+        if (!query.exec()) {
+            qCritical() << "select img_folders failed" << query.lastError();
+            return {};
+        }
+        if (query.next())
+            ret << path;
+        query.finish();
+    }
+    return ret;
+}
+
+std::optional<QVector<schema::FolderPreview>>
 DataStore::DbListAllFolderPreviews(QSqlDatabase &db) {
     QElapsedTimer timer;
     timer.start();
-    QList<schema::FolderPreview> ret;
+    QVector<schema::FolderPreview> ret;
     QSqlQuery query{db};
-    if (!query.exec("SELECT img_folders.fid as fid, folder_path, title, record_time, "
-                    "cover_base64, eh_gid "
-                    "FROM img_folders LEFT JOIN cover_images "
-                    "ON img_folders.fid == cover_images.fid")) {
-        qCritical() << "select join failed" << query.lastError();
+    query.setForwardOnly(true);
+    // a folder without a cover is not listed, as in every other result
+    if (!query.exec(schema::SelectSql<schema::FolderPreview>() +
+                    " WHERE fid IN (SELECT fid FROM cover_images)")) {
+        qCritical() << "select img_folders failed" << query.lastError();
         return {};
     }
 
     while (query.next()) {
-        auto data = schema::FolderPreview{
-            .fid = query.value("fid").toLongLong(),
-            .folder_path = query.value("folder_path").toString(),
-            .title = query.value("title").toString(),
-            .record_time = query.value("record_time").toLongLong(),
-            .cover_base64 = query.value("cover_base64").toString(),
-            .eh_gid = query.value("eh_gid").toString(),
-        };
-        if (data.folder_path.isEmpty() || data.title.isEmpty() ||
-            data.cover_base64.isEmpty()) {
+        auto data = schema::ReadRow<schema::FolderPreview>(query);
+        if (data.folder_path.isEmpty() || data.title.isEmpty()) {
             qCritical() << "failed to parse data row for fid " << data.fid;
             continue;
         }
@@ -237,152 +810,420 @@ DataStore::DbListAllFolderPreviews(QSqlDatabase &db) {
     return ret;
 }
 
-std::optional<QMap<int64_t, QStringList>>
-DataStore::DbListSearchKeywords(QSqlDatabase &db) {
+namespace {
+// Large IN lists are split into queries of this many fids.
+constexpr size_t kFidsPerQuery = 500;
+
+// "(1,2,3)", fids are integers so they are safe to inline into the sql.
+QString SqlFidList(const int64_t *begin, const int64_t *end) {
+    QStringList list;
+    for (const int64_t *it = begin; it != end; it++)
+        list << QString::number(*it);
+    return "(" + list.join(",") + ")";
+}
+
+// Folders joined with their search document, both are read in fid order. Folders
+// without a cover_images row are left out, they are never search results.
+// `where` filters img_folders, which is aliased as "if".
+QString SearchDocsSql(const QString &where) {
+    return QString("SELECT %1, %2 FROM img_folders AS if "
+                   "INNER JOIN cover_images AS ci ON ci.fid == if.fid "
+                   "LEFT JOIN search_docs AS sd ON sd.fid == if.fid %3 ORDER BY if.fid")
+        .arg(schema::ColumnList<schema::ImageFolders>("if"),
+             schema::ColumnList<schema::SearchDocs>("sd"), where);
+}
+
+void ReadSearchDocs(QSqlQuery *query, QList<schema::FolderSearchDoc> *out) {
+    constexpr int kDocColumn = schema::kFieldCount<schema::ImageFolders>;
+    while (query->next()) {
+        *out << schema::FolderSearchDoc{
+            .folder = schema::ReadRow<schema::ImageFolders>(*query),
+            .doc = schema::ReadRow<schema::SearchDocs>(*query, kDocColumn),
+        };
+    }
+}
+
+} // namespace
+
+std::optional<QList<schema::FolderSearchDoc>>
+DataStore::DbListSearchDocs(QSqlDatabase &db) {
     QElapsedTimer timer;
     timer.start();
 
-    QMap<int64_t, QStringList> ret;
+    QList<schema::FolderSearchDoc> ret;
     QSqlQuery query(db);
-    QString sql = "";
-    // local keywords
-    sql = "SELECT if.fid AS fid, namespace||':'||stem AS kw "
-          "FROM img_folders AS if INNER JOIN folder_tags AS ft "
-          "ON if.fid == ft.fid ";
-    // ehentai keywords
-    sql += "UNION "
-           "SELECT if.fid AS fid, tag AS kw "
-           "FROM img_folders AS if INNER JOIN ehentai_tags AS et "
-           "ON if.eh_gid == et.gid ";
-    // local title
-    sql += "UNION SELECT fid, title AS kw FROM img_folders ";
-    // ehentai title
-    sql += "UNION "
-           "SELECT if.fid AS fid, em.title AS kw "
-           "FROM img_folders AS if INNER JOIN ehentai_metadata AS em "
-           "ON if.eh_gid == em.gid ";
-    // ehentai jpn_title
-    sql += "UNION "
-           "SELECT if.fid AS fid, em.title_jpn AS kw "
-           "FROM img_folders AS if INNER JOIN ehentai_metadata AS em "
-           "ON if.eh_gid == em.gid ";
-    if (!query.exec(sql)) {
-        qCritical() << "select join failed" << query.lastError();
+    query.setForwardOnly(true);
+    if (!query.exec(SearchDocsSql(""))) {
+        qCritical() << "select search_docs failed" << query.lastError();
         return {};
     }
-    while (query.next()) {
-        uint64_t fid = query.value("fid").toULongLong();
-        QString kw = query.value("kw").toString();
-        if (kw.isNull() || kw.length() == 0)
-            continue;
-        ret[fid] << kw;
-    }
-    qInfo() << "DbListSearchKeywords() completed in " << timer.elapsed() << "ms";
+    ReadSearchDocs(&query, &ret);
+    qInfo() << "DbListSearchDocs() completed in " << timer.elapsed() << "ms";
     // TODO unicode normalize
     return ret;
 }
 
-namespace {
-// forall re in regex, exists kw in kws s.t. re matches kw
-bool MatchesAll(const QStringList &kws, const std::vector<QRegExp> &regex) {
-    for (const auto &r : regex) {
-        bool has_kw_match = false;
-        for (const QString &s : kws) {
-            if (r.indexIn(s) >= 0) {
-                has_kw_match = true;
-                break;
-            }
+std::optional<QList<schema::FolderSearchDoc>>
+DataStore::DbQuerySearchDocs(QSqlDatabase &db, const std::vector<int64_t> &fids) {
+    QList<schema::FolderSearchDoc> ret;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    for (size_t i = 0; i < fids.size(); i += kFidsPerQuery) {
+        size_t end = std::min(fids.size(), i + kFidsPerQuery);
+        if (!query.exec(SearchDocsSql(
+                "WHERE if.fid IN " + SqlFidList(fids.data() + i, fids.data() + end)))) {
+            qCritical() << "select search_docs failed" << query.lastError();
+            return {};
         }
-        if (!has_kw_match)
-            return false;
+        ReadSearchDocs(&query, &ret);
     }
+    return ret;
+}
 
-    return true;
+namespace {
+// a folder and the title_norms form of its title
+struct SimilarCandidate {
+    schema::FolderPreview preview;
+    QString normalized;
+};
+
+// Folders with their title_norms row, in fid order. `where` filters img_folders,
+// which is aliased as "if".
+QString SimilarCandidatesSql(const QString &where) {
+    return QString("SELECT %1, tn.title, tn.normalized FROM img_folders AS if "
+                   "INNER JOIN cover_images AS ci ON ci.fid == if.fid "
+                   "LEFT JOIN title_norms AS tn ON tn.fid == if.fid %2 ORDER BY if.fid")
+        .arg(schema::ColumnList<schema::FolderPreview>("if"), where);
 }
 
-// exists kw in kws, exists re in regex s.t. re matches kw
-bool MatchesAny(const QStringList &kws, const std::vector<QRegExp> &regex) {
-    for (const QString &s : kws) {
-        for (const auto &r : regex) {
-            if (r.indexIn(s) >= 0)
-                return true;
+// Read the rows of SimilarCandidatesSql(), return the number of rows missing or with a
+// stale title_norms row, normalized here instead.
+int64_t ReadSimilarCandidates(QSqlQuery *query, QVector<SimilarCandidate> *out) {
+    constexpr int kNormColumn = schema::kFieldCount<schema::FolderPreview>;
+    int64_t stale = 0;
+    while (query->next()) {
+        SimilarCandidate candidate{schema::ReadRow<schema::FolderPreview>(*query),
+                                   query->value(kNormColumn + 1).toString()};
+        // missing, or computed from an older title
+        if (query->value(kNormColumn).toString() != candidate.preview.title) {
+            candidate.normalized = FuzzSearcher::NormalizeTitle(candidate.preview.title);
+            stale++;
         }
+        *out << std::move(candidate);
     }
-    return false;
+    return stale;
 }
-} // namespace
 
-std::optional<QList<schema::FolderPreview>>
-DataStore::DbSearch(QSqlDatabase &db, QStringList include_kw, QStringList exclude_kw) {
-    std::vector<QRegExp> include_regex;
-    std::vector<QRegExp> exclude_regex;
-    std::unordered_set<int64_t> selected_fid;
-    for (const QString &s : include_kw) {
-        QRegExp r{s};
-        if (!r.isValid()) {
-            qCritical() << "Invalid search regex: " << s;
-            return {};
-        }
-        r.setCaseSensitivity(Qt::CaseInsensitive);
-        include_regex.push_back(r);
+// Sorted fids of the folders that may be similar: those in the postings of `grams`,
+// plus those whose title_norms row is missing or stale, their trigrams aren't indexed.
+std::optional<std::vector<int64_t>>
+ListGramCandidates(QSqlDatabase &db, const std::vector<int64_t> &grams) {
+    std::vector<int64_t> ret;
+    QSqlQuery query{db};
+    query.setForwardOnly(true);
+    if (!query.prepare("SELECT fids FROM title_grams WHERE gram = ?")) {
+        qCritical() << query.lastError();
+        return {};
     }
-    for (const QString &s : exclude_kw) {
-        QRegExp r{s};
-        if (!r.isValid()) {
-            qCritical() << "Invalid search regex: " << s;
+    for (int64_t gram : grams) {
+        query.bindValue(0, qlonglong(gram));
+        if (!query.exec()) {
+            qCritical() << query.lastError();
             return {};
         }
-        r.setCaseSensitivity(Qt::CaseInsensitive);
-        exclude_regex.push_back(r);
+        if (query.next()) {
+            std::vector<int64_t> fids = PostingList::Decode(query.value(0).toByteArray());
+            ret.insert(ret.end(), fids.begin(), fids.end());
+        }
+        query.finish();
     }
-    auto keywords = DbListSearchKeywords(db);
-    if (!keywords)
-        return {};
-    auto all_previews = DbListAllFolderPreviews(db);
-    if (!all_previews)
+    if (!query.exec("SELECT if.fid FROM img_folders AS if "
+                    "LEFT JOIN title_norms AS tn ON tn.fid == if.fid "
+                    "WHERE tn.title IS NULL OR tn.title != if.title")) {
+        qCritical() << query.lastError();
         return {};
-    QList<schema::FolderPreview> ret;
+    }
+    while (query.next())
+        ret.push_back(query.value(0).toLongLong());
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
 
-    QElapsedTimer timer;
-    timer.start();
-    for (auto it = keywords->constKeyValueBegin(); it != keywords->constKeyValueEnd();
-         it++) {
-        const auto &fid = it->first;
-        const auto &kws = it->second;
-        if (MatchesAll(kws, include_regex) && !MatchesAny(kws, exclude_regex))
-            selected_fid.insert(fid);
+// Terms without regex special characters are plain substrings, search_fts can answer
+// them if they are long enough to form a trigram.
+bool IsFtsTerm(const QString &term) {
+    return SearchTerm::IsLiteral(term) && term.toUcs4().size() >= 3;
+}
+
+// fids of folders having a keyword that contains `term`, case insensitive
+std::optional<QSet<int64_t>> FtsMatch(QSqlDatabase &db, QString term) {
+    QSqlQuery query{db};
+    // the rowid is the fid
+    if (!query.prepare("SELECT rowid FROM search_fts WHERE search_fts MATCH ?")) {
+        qCritical() << query.lastError();
+        return {};
     }
-    for (const auto &r : *all_previews) {
-        if (selected_fid.find(r.fid) != selected_fid.end()) {
-            ret << r;
+    // match as a phrase, so the term is not parsed as fts5 query syntax
+    query.addBindValue("\"" + term.replace("\"", "\"\"") + "\"");
+    if (!query.exec()) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    QSet<int64_t> ret;
+    while (query.next())
+        ret.insert(query.value(0).toLongLong());
+    return ret;
+}
+} // namespace
+
+std::optional<QVector<schema::FolderPreview>>
+DataStore::DbSearch(QSqlDatabase &db, QStringList include_kw, QStringList exclude_kw,
+                    const std::atomic<bool> *cancelled) {
+    // plain substrings are answered by search_fts
+    std::optional<QSet<int64_t>> fts_candidates; // nothing else can match if set
+    QSet<int64_t> fts_excluded;
+    QStringList regex_include_kw = include_kw;
+    QStringList regex_exclude_kw = exclude_kw;
+    if (fts_enabled) {
+        QElapsedTimer timer;
+        timer.start();
+        bool fts_ok = true;
+        regex_include_kw.clear();
+        regex_exclude_kw.clear();
+        for (const QString &s : qAsConst(include_kw)) {
+            if (!IsFtsTerm(s)) {
+                regex_include_kw << s;
+                continue;
+            }
+            auto fids = FtsMatch(db, s);
+            if (!fids) {
+                fts_ok = false;
+                break;
+            }
+            if (fts_candidates)
+                fts_candidates->intersect(*fids);
+            else
+                fts_candidates = std::move(fids);
+        }
+        for (const QString &s : qAsConst(exclude_kw)) {
+            if (!fts_ok)
+                break;
+            if (!IsFtsTerm(s)) {
+                regex_exclude_kw << s;
+                continue;
+            }
+            auto fids = FtsMatch(db, s);
+            if (!fids) {
+                fts_ok = false;
+                break;
+            }
+            fts_excluded.unite(*fids);
         }
+        if (fts_ok) {
+            qInfo() << "DbSearch() full text matching finished in " << timer.elapsed()
+                    << "ms";
+        } else {
+            qWarning() << "Full text search failed, disabled";
+            fts_enabled = false;
+            fts_candidates.reset();
+            fts_excluded.clear();
+            regex_include_kw = include_kw;
+            regex_exclude_kw = exclude_kw;
+        }
+    }
+
+    std::vector<SearchTerm> include_terms;
+    std::vector<SearchTerm> exclude_terms;
+    for (const QString &s : qAsConst(regex_include_kw)) {
+        auto term = SearchTerm::Compile(s);
+        if (!term)
+            return {};
+        include_terms.push_back(std::move(*term));
     }
+    for (const QString &s : qAsConst(regex_exclude_kw)) {
+        auto term = SearchTerm::Compile(s);
+        if (!term)
+            return {};
+        exclude_terms.push_back(std::move(*term));
+    }
+    auto &index = GetSearchIndex();
+    if (!index.isLoaded() && !index.rebuild(db))
+        return {};
+
+    QElapsedTimer timer;
+    timer.start();
+    QVector<schema::FolderPreview> ret =
+        index.search(include_terms, exclude_terms,
+                     fts_candidates ? &*fts_candidates : nullptr, &fts_excluded,
+                     cancelled);
     qInfo() << "DbSearch() matching and filtering finished in " << timer.elapsed()
             << "ms";
     return ret;
 }
 
-std::optional<QList<schema::FolderPreview>> DataStore::DbSearchSimilar(QSqlDatabase &db,
-                                                                       QString title) {
-    auto all_previews = DbListAllFolderPreviews(db);
-    if (!all_previews)
-        return {};
-    QList<schema::FolderPreview> ret;
+std::optional<QVector<schema::FolderPreview>>
+DataStore::DbSearchSimilar(QSqlDatabase &db, QString title,
+                           const std::atomic<bool> *cancelled) {
     QElapsedTimer timer;
     timer.start();
     FuzzSearcher searcher;
-    ret = searcher.filterMatching<schema::FolderPreview>(
-        *all_previews, title, [](const schema::FolderPreview &pv) { return pv.title; });
+    // only the folders sharing a trigram with the title can reach the thresholds
+    std::optional<std::vector<int64_t>> fids;
+    if (auto grams = searcher.candidateGrams(title)) {
+        fids = ListGramCandidates(db, *grams);
+        if (!fids)
+            return {};
+        qInfo() << "DbSearchSimilar()" << grams->size() << "trigrams narrowed to"
+                << fids->size() << "candidates in" << timer.elapsed() << "ms";
+    }
+
+    timer.start();
+    QVector<SimilarCandidate> candidates;
+    int64_t stale = 0;
+    QSqlQuery query{db};
+    query.setForwardOnly(true);
+    if (!fids) {
+        if (!query.exec(SimilarCandidatesSql(""))) {
+            qCritical() << "select title_norms failed" << query.lastError();
+            return {};
+        }
+        stale += ReadSimilarCandidates(&query, &candidates);
+    } else {
+        for (size_t i = 0; i < fids->size(); i += kFidsPerQuery) {
+            size_t end = std::min(fids->size(), i + kFidsPerQuery);
+            if (!query.exec(SimilarCandidatesSql(
+                    "WHERE if.fid IN " +
+                    SqlFidList(fids->data() + i, fids->data() + end)))) {
+                qCritical() << "select title_norms failed" << query.lastError();
+                return {};
+            }
+            stale += ReadSimilarCandidates(&query, &candidates);
+        }
+    }
+    qInfo() << "DbSearchSimilar() loaded" << candidates.size() << "titles in"
+            << timer.elapsed() << "ms," << stale << "normalized on the fly";
+
+    timer.start();
+    const QVector<SimilarCandidate> matched = searcher.filterMatching<SimilarCandidate>(
+        candidates, title, [](const SimilarCandidate &c) { return c.normalized; },
+        cancelled);
+    QVector<schema::FolderPreview> ret;
+    ret.reserve(matched.size());
+    for (const SimilarCandidate &candidate : matched)
+        ret << candidate.preview;
     qInfo() << "DbSearchSimilar() matching and filtering finished in" << timer.elapsed()
             << "ms";
     return ret;
 }
 
+std::optional<QVector<schema::FolderPreview>>
+DataStore::DbFindDuplicates(QSqlDatabase &db, const std::atomic<bool> *cancelled) {
+    QElapsedTimer timer;
+    timer.start();
+    QSqlQuery query{db};
+    query.setForwardOnly(true);
+    if (!query.exec(SimilarCandidatesSql(""))) {
+        qCritical() << "select title_norms failed" << query.lastError();
+        return {};
+    }
+    QVector<SimilarCandidate> candidates;
+    int64_t stale = ReadSimilarCandidates(&query, &candidates);
+    QStringList titles;
+    QStringList normalized;
+    titles.reserve(candidates.size());
+    normalized.reserve(candidates.size());
+    for (const SimilarCandidate &candidate : qAsConst(candidates)) {
+        titles << candidate.preview.title;
+        normalized << candidate.normalized;
+    }
+    qInfo() << "DbFindDuplicates() loaded" << candidates.size() << "titles in"
+            << timer.elapsed() << "ms," << stale << "normalized on the fly";
+
+    timer.start();
+    const auto clusters = DuplicateClusterer::Cluster(titles, normalized, cancelled);
+    QVector<schema::FolderPreview> ret;
+    for (const std::vector<int> &cluster : clusters) {
+        for (int i : cluster)
+            ret << candidates[i].preview;
+    }
+    qInfo() << "DbFindDuplicates() found" << clusters.size() << "clusters in"
+            << timer.elapsed() << "ms";
+    return ret;
+}
+
+std::optional<QVector<schema::FolderPreview>>
+DataStore::DbSearchSimilarCover(QSqlDatabase &db, int64_t fid) {
+    QElapsedTimer timer;
+    timer.start();
+    QSqlQuery query{db};
+    query.setForwardOnly(true);
+    if (!query.prepare("SELECT dhash FROM cover_hashes WHERE fid = ?")) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    query.addBindValue(qlonglong(fid));
+    if (!query.exec()) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    std::optional<uint64_t> dhash;
+    if (query.next())
+        dhash = uint64_t(query.value(0).toLongLong());
+    query.finish();
+    if (!dhash) {
+        // not hashed yet, or not decodable
+        auto cover = DbQueryCoverImages(db, fid);
+        if (cover)
+            dhash = ImageHash::DHash(cover->cover);
+        if (!dhash) {
+            qWarning() << "no cover hash for fid=" << fid;
+            return QVector<schema::FolderPreview>{};
+        }
+    }
+
+    // every hash within kMaxCoverDistance shares a block with this one
+    static_assert(kMaxCoverDistance < 4, "the covers are looked up by 4 blocks");
+    if (!query.prepare(QString("SELECT %1, ch.dhash FROM cover_hashes AS ch "
+                               "JOIN img_folders AS if ON if.fid == ch.fid "
+                               "WHERE ch.block0 = ? OR ch.block1 = ? "
+                               "OR ch.block2 = ? OR ch.block3 = ?")
+                           .arg(schema::ColumnList<schema::FolderPreview>("if")))) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    for (int block = 0; block < 4; block++)
+        query.addBindValue(qlonglong(*dhash >> (16 * block) & 0xffff));
+    if (!query.exec()) {
+        qCritical() << "select cover_hashes failed" << query.lastError();
+        return {};
+    }
+    constexpr int kHashColumn = schema::kFieldCount<schema::FolderPreview>;
+    std::vector<std::pair<int, schema::FolderPreview>> matches;
+    while (query.next()) {
+        int distance =
+            ImageHash::Distance(*dhash, uint64_t(query.value(kHashColumn).toLongLong()));
+        if (distance <= kMaxCoverDistance)
+            matches.emplace_back(distance, schema::ReadRow<schema::FolderPreview>(query));
+    }
+    // the closest first, the folder itself leads
+    std::sort(matches.begin(), matches.end(), [](const auto &a, const auto &b) {
+        return std::make_pair(a.first, a.second.fid) <
+               std::make_pair(b.first, b.second.fid);
+    });
+    QVector<schema::FolderPreview> ret;
+    ret.reserve(int(matches.size()));
+    for (const auto &match : matches)
+        ret << match.second;
+    qInfo() << "DbSearchSimilarCover() found" << ret.size() << "covers in"
+            << timer.elapsed() << "ms";
+    return ret;
+}
+
 optional<schema::CoverImages> DataStore::DbQueryCoverImages(QSqlDatabase &db,
                                                             int64_t fid) {
     QSqlQuery query{db};
-    QString sql = "SELECT fid, cover_fname, cover_base64 FROM cover_images WHERE fid=?";
-    if (!query.prepare(sql)) {
+    if (!query.prepare(schema::SelectSql<schema::CoverImages>() + " WHERE fid=?")) {
         qCritical() << query.lastError();
         return {};
     }
@@ -392,11 +1233,7 @@ optional<schema::CoverImages> DataStore::DbQueryCoverImages(QSqlDatabase &db,
         return {};
     }
     while (query.next()) {
-        auto data = schema::CoverImages{
-            .fid = query.value("fid").toLongLong(),
-            .cover_fname = query.value("cover_fname").toString(),
-            .cover_base64 = query.value("cover_base64").toString(),
-        };
+        auto data = schema::ReadRow<schema::CoverImages>(query);
         assert(!query.next());
         return data;
     }
@@ -404,6 +1241,24 @@ optional<schema::CoverImages> DataStore::DbQueryCoverImages(QSqlDatabase &db,
     return {};
 }
 
+std::optional<QHash<int64_t, QByteArray>>
+DataStore::DbQueryCovers(QSqlDatabase &db, const std::vector<int64_t> &fids) {
+    QHash<int64_t, QByteArray> ret;
+    QSqlQuery query{db};
+    query.setForwardOnly(true);
+    for (size_t i = 0; i < fids.size(); i += kFidsPerQuery) {
+        size_t end = std::min(fids.size(), i + kFidsPerQuery);
+        if (!query.exec("SELECT fid, cover FROM cover_images WHERE fid IN " +
+                        SqlFidList(fids.data() + i, fids.data() + end))) {
+            qCritical() << "select covers failed" << query.lastError();
+            return {};
+        }
+        while (query.next())
+            ret.insert(query.value(0).toLongLong(), query.value(1).toByteArray());
+    }
+    return ret;
+}
+
 namespace {
 std::optional<schema::EhentaiMetadata> DbQueryEhMetaInternal(QSqlQuery &query) {
     if (!query.exec()) {
@@ -411,23 +1266,7 @@ std::optional<schema::EhentaiMetadata> DbQueryEhMetaInternal(QSqlQuery &query) {
         return {};
     }
     if (query.next()) {
-        return schema::EhentaiMetadata{
-            .gid = query.value("gid").toString(),
-            .token = query.value("token").toString(),
-            .title = query.value("title").toString(),
-            .title_jpn = query.value("title_jpn").toString(),
-            .category = EhentaiApi::CategoryFromString(
-                            query.value("category").toString().toStdString())
-                            .value_or(EhCategory::UNKNOWN),
-            .thumb = query.value("thumb").toString(),
-            .uploader = query.value("uploader").toString(),
-            .posted = query.value("posted").toLongLong(),
-            .filecount = query.value("filecount").toLongLong(),
-            .filesize = query.value("filesize").toLongLong(),
-            .expunged = query.value("expunged").toLongLong(),
-            .rating = query.value("rating").toDouble(),
-            .meta_updated = query.value("meta_updated").toLongLong(),
-        };
+        return schema::ReadRow<schema::EhentaiMetadata>(query);
     } else {
         qCritical() << "No ehentai_metadata found";
         return {};
@@ -438,8 +1277,7 @@ std::optional<schema::EhentaiMetadata> DbQueryEhMetaInternal(QSqlQuery &query) {
 std::optional<schema::EhentaiMetadata> DataStore::DbQueryEhMetaByGid(QSqlDatabase &db,
                                                                      QString gid) {
     QSqlQuery query{db};
-    QString sql = "SELECT * FROM ehentai_metadata WHERE gid=?";
-    if (!query.prepare(sql)) {
+    if (!query.prepare(schema::SelectSql<schema::EhentaiMetadata>() + " WHERE gid=?")) {
         qCritical() << query.lastError();
         return {};
     }
@@ -449,7 +1287,8 @@ std::optional<schema::EhentaiMetadata> DataStore::DbQueryEhMetaByGid(QSqlDatabas
 std::optional<schema::EhentaiMetadata> DataStore::DbQueryEhMetaByFid(QSqlDatabase &db,
                                                                      int64_t fid) {
     QSqlQuery query{db};
-    QString sql = "SELECT * FROM ehentai_metadata AS em "
+    QString sql = "SELECT " + schema::ColumnList<schema::EhentaiMetadata>("em") +
+                  " FROM ehentai_metadata AS em "
                   "INNER JOIN img_folders AS if "
                   "ON if.eh_gid = em.gid "
                   "WHERE if.fid=?";
@@ -487,67 +1326,79 @@ std::optional<QStringList> DataStore::DbQueryEhTagsByGid(QSqlDatabase &db, QStri
 }
 
 bool DataStore::DbInsert(QSqlDatabase &db, schema::ImageFolders data) {
+    return DbBulkInsert(db, std::vector<schema::ImageFolders>{std::move(data)});
+}
+
+bool DataStore::DbInsert(QSqlDatabase &db, schema::CoverImages data) {
+    return DbBulkInsert(db, std::vector<schema::CoverImages>{std::move(data)});
+}
+
+bool DataStore::DbInsert(QSqlDatabase &db, schema::EhentaiMetadata data) {
+    return DbBulkInsert(db, std::vector<schema::EhentaiMetadata>{std::move(data)});
+}
+
+bool DataStore::DbBulkInsert(QSqlDatabase &db,
+                             const std::vector<schema::ImageFolders> &rows) {
     QSqlQuery query{db};
-    if (!query.prepare("INSERT INTO img_folders(fid, folder_path, title, record_time, "
-                       "eh_gid) VALUES(?,?,?,?,?)")) {
+    if (!query.prepare(schema::InsertSql<schema::ImageFolders>())) {
         qCritical() << query.lastError();
         return false;
     }
-    query.addBindValue(qlonglong(data.fid));
-    query.addBindValue(data.folder_path);
-    query.addBindValue(data.title);
-    query.addBindValue(qlonglong(data.record_time));
-    query.addBindValue(data.eh_gid);
-    bool success = query.exec();
-    if (!success)
-        qCritical() << query.lastError();
-    return success;
+    bool track_index = TracksSearchIndex(db);
+    std::vector<schema::TitleNorms> title_norms;
+    title_norms.reserve(rows.size());
+    for (const schema::ImageFolders &data : rows) {
+        schema::BindRow(&query, data);
+        if (!query.exec()) {
+            qCritical() << query.lastError();
+            return false;
+        }
+        if (track_index)
+            GetSearchIndex().markFolderDirty(data.fid);
+        title_norms.push_back(MakeTitleNorms(data.fid, data.title));
+    }
+    return UpsertTitleNorms(db, title_norms) && IndexTitleGrams(db, title_norms);
 }
 
-bool DataStore::DbInsert(QSqlDatabase &db, schema::CoverImages data) {
+bool DataStore::DbBulkInsert(QSqlDatabase &db,
+                             const std::vector<schema::CoverImages> &rows) {
+    // folders are only searchable once they have a cover
+    bool track_index = TracksSearchIndex(db);
     QSqlQuery query{db};
-    if (!query.prepare(
-            "INSERT INTO cover_images(fid, cover_fname, cover_base64) VALUES(?,?,?)")) {
+    if (!query.prepare(schema::InsertSql<schema::CoverImages>())) {
         qCritical() << query.lastError();
         return false;
     }
-    query.addBindValue(qlonglong(data.fid));
-    query.addBindValue(data.cover_fname);
-    query.addBindValue(data.cover_base64);
-    bool success = query.exec();
-    if (!success)
-        qCritical() << query.lastError();
-    return success;
+    for (const schema::CoverImages &data : rows) {
+        schema::BindRow(&query, data);
+        if (!query.exec()) {
+            qCritical() << query.lastError();
+            return false;
+        }
+        if (track_index)
+            GetSearchIndex().markFolderDirty(data.fid);
+    }
+    return UpsertCoverHashes(db, HashCovers(rows));
 }
 
-bool DataStore::DbInsert(QSqlDatabase &db, schema::EhentaiMetadata data) {
+bool DataStore::DbBulkInsert(QSqlDatabase &db,
+                             const std::vector<schema::EhentaiMetadata> &rows) {
     QSqlQuery query{db};
-    QString sql = "INSERT INTO ehentai_metadata("
-                  "gid, token, title, title_jpn, category, thumb, uploader, posted, "
-                  "filecount, filesize, expunged, "
-                  "rating, meta_updated) VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?)";
-    if (!query.prepare(sql)) {
+    if (!query.prepare(schema::InsertSql<schema::EhentaiMetadata>())) {
         qCritical() << query.lastError();
         return false;
     }
-    query.addBindValue(data.gid);
-    query.addBindValue(data.token);
-    query.addBindValue(data.title);
-    query.addBindValue(data.title_jpn);
-    query.addBindValue(
-        QString::fromStdString(EhentaiApi::CategoryToString(data.category)));
-    query.addBindValue(data.thumb);
-    query.addBindValue(data.uploader);
-    query.addBindValue(data.posted);
-    query.addBindValue(data.filecount);
-    query.addBindValue(data.filesize);
-    query.addBindValue(data.expunged);
-    query.addBindValue(data.rating);
-    query.addBindValue(data.meta_updated);
-    bool success = query.exec();
-    if (!success)
-        qCritical() << query.lastError();
-    return success;
+    bool track_index = TracksSearchIndex(db);
+    for (const schema::EhentaiMetadata &data : rows) {
+        schema::BindRow(&query, data);
+        if (!query.exec()) {
+            qCritical() << query.lastError();
+            return false;
+        }
+        if (track_index)
+            GetSearchIndex().markGidDirty(data.gid);
+    }
+    return true;
 }
 
 bool DataStore::DbInsertReqTransaction(QSqlDatabase &db, const EhGalleryMetadata &data) {
@@ -585,8 +1436,31 @@ bool DataStore::DbInsertReqTransaction(QSqlDatabase &db, const EhGalleryMetadata
     return DbReplaceEhTagsReqTransaction(db, d.gid, new_tag_list);
 }
 
+namespace {
+// Rebuild the search_docs rows of the folders matching `where`, see
+// schema::SearchDocs::RefreshSql(). `where` has a single placeholder for `value`.
+bool RefreshSearchDocs(QSqlDatabase &db, const QString &where, const QVariant &value) {
+    QSqlQuery query{db};
+    const QStringList statements = schema::SearchDocs::RefreshSql(where);
+    for (const QString &sql : statements) {
+        if (!query.prepare(sql)) {
+            qCritical() << query.lastError();
+            return false;
+        }
+        query.addBindValue(value);
+        if (!query.exec()) {
+            qCritical() << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
 bool DataStore::DbReplaceEhTagsReqTransaction(QSqlDatabase &db, QString gid,
                                               QStringList tags) {
+    if (TracksSearchIndex(db))
+        GetSearchIndex().markGidDirty(gid);
     QSqlQuery del_query{db};
     if (!del_query.prepare("DELETE FROM ehentai_tags WHERE gid=?")) {
         qCritical() << del_query.lastError();
@@ -616,78 +1490,200 @@ bool DataStore::DbReplaceEhTagsReqTransaction(QSqlDatabase &db, QString gid,
             return false;
         }
     }
+    // once for all the tags, ehentai_tags has no triggers
+    return RefreshSearchDocs(db, "WHERE if.eh_gid = ?", gid);
+}
+
+bool DataStore::DbRefreshSearchDocsReqTransaction(QSqlDatabase &db,
+                                                  const std::vector<int64_t> &fids) {
+    for (int64_t fid : fids) {
+        if (!RefreshSearchDocs(db, "WHERE if.fid = ?", qlonglong(fid)))
+            return false;
+        if (TracksSearchIndex(db))
+            GetSearchIndex().markFolderDirty(fid);
+    }
+    return true;
+}
+
+std::optional<int64_t>
+DataStore::DbDeleteFoldersReqTransaction(QSqlDatabase &db,
+                                         const QStringList &folder_paths) {
+    QSqlQuery select_query{db};
+    select_query.setForwardOnly(true);
+    if (!select_query.prepare("SELECT fid FROM img_folders WHERE folder_path = ?")) {
+        qCritical() << select_query.lastError();
+        return {};
+    }
+    std::vector<int64_t> fids;
+    for (const QString &path : folder_paths) {
+        select_query.addBindValue(path);
+        if (!select_query.exec()) {
+            qCritical() << select_query.lastError();
+            return {};
+        }
+        if (select_query.next())
+            fids.push_back(select_query.value(0).toLongLong());
+        select_query.finish();
+    }
+
+    // the trigger of search_docs on img_folders deletes the documents
+    QSqlQuery query{db};
+    for (const char *sql : {"DELETE FROM folder_tags WHERE fid = ?",
+                            "DELETE FROM cover_images WHERE fid = ?",
+                            "DELETE FROM img_folders WHERE fid = ?"}) {
+        if (!query.prepare(sql)) {
+            qCritical() << query.lastError();
+            return {};
+        }
+        for (int64_t fid : fids) {
+            query.addBindValue(qlonglong(fid));
+            if (!query.exec()) {
+                qCritical() << query.lastError();
+                return {};
+            }
+        }
+    }
+    for (int64_t fid : fids) {
+        if (TracksSearchIndex(db))
+            GetSearchIndex().markFolderDirty(fid);
+    }
+    return fids.size();
+}
+
+std::optional<schema::ImportJournal>
+DataStore::DbBeginImport(QSqlDatabase &db, const QString &kind, const QString &source) {
+    QSqlQuery query{db};
+    query.setForwardOnly(true);
+    if (!query.prepare(schema::SelectSql<schema::ImportJournal>() +
+                       " WHERE kind = ? AND source = ? AND finished_at = 0 "
+                       "ORDER BY id DESC LIMIT 1")) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    query.addBindValue(kind);
+    query.addBindValue(source);
+    if (!query.exec()) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    if (query.next())
+        return schema::ReadRow<schema::ImportJournal>(query);
+    query.finish();
+
+    qlonglong now = QDateTime::currentSecsSinceEpoch();
+    if (!query.prepare("INSERT INTO import_journal(kind, source, started_at, updated_at, "
+                       "imported, finished_at) VALUES(?, ?, ?, ?, 0, 0)")) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    query.addBindValue(kind);
+    query.addBindValue(source);
+    query.addBindValue(now);
+    query.addBindValue(now);
+    if (!query.exec()) {
+        qCritical() << query.lastError();
+        return {};
+    }
+    return schema::ImportJournal{
+        .id = query.lastInsertId().toLongLong(),
+        .kind = kind,
+        .source = source,
+        .started_at = now,
+        .updated_at = now,
+        .imported = 0,
+        .finished_at = 0,
+    };
+}
+
+bool DataStore::DbUpdateImportJournalReqTransaction(QSqlDatabase &db, int64_t id,
+                                                    int64_t imported, bool finished) {
+    QSqlQuery query{db};
+    if (!query.prepare("UPDATE import_journal SET imported = imported + ?, "
+                       "updated_at = ?, finished_at = ? WHERE id = ?")) {
+        qCritical() << query.lastError();
+        return false;
+    }
+    qlonglong now = QDateTime::currentSecsSinceEpoch();
+    query.addBindValue(qlonglong(imported));
+    query.addBindValue(now);
+    query.addBindValue(finished ? now : 0);
+    query.addBindValue(qlonglong(id));
+    if (!query.exec()) {
+        qCritical() << query.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool DataStore::DbUpdateDirFingerprintsReqTransaction(
+    QSqlDatabase &db, const std::vector<schema::DirFingerprints> &listed,
+    const QStringList &removed_paths) {
+    QSqlQuery query{db};
+    if (!query.prepare("DELETE FROM dir_fingerprints WHERE path = ?")) {
+        qCritical() << query.lastError();
+        return false;
+    }
+    for (const QString &path : removed_paths) {
+        query.addBindValue(path);
+        if (!query.exec()) {
+            qCritical() << query.lastError();
+            return false;
+        }
+    }
+
+    if (!query.prepare(
+            schema::InsertSql<schema::DirFingerprints>("INSERT OR REPLACE"))) {
+        qCritical() << query.lastError();
+        return false;
+    }
+    for (const schema::DirFingerprints &fp : listed) {
+        schema::BindRow(&query, fp);
+        if (!query.exec()) {
+            qCritical() << query.lastError();
+            return false;
+        }
+    }
     return true;
 }
 
 std::optional<QString> DataStore::DbTransaction(std::function<bool(QSqlDatabase *)> f,
                                                 QString connection_name) {
+    // sqlite allows a single writer anyway, waiting here is cheaper than busy retries
+    static QRecursiveMutex writer_mutex;
+    QMutexLocker writer_locker(&writer_mutex);
+
     auto db = OpenDatabase(connection_name).value();
     if (!db.transaction()) {
         return "failed to start transaction";
     }
 
+    // reload whatever the transaction touched, committed or not
+    auto apply_index_changes = [&db] { GetSearchIndex().applyPending(db); };
+
     bool need_submit;
     try {
         need_submit = f(&db);
     } catch (...) {
         db.rollback();
+        apply_index_changes();
         return "exception thrown when executing transaction function";
     }
 
     if (need_submit) {
         if (!db.commit()) {
+            apply_index_changes();
             return "database transaction commit failed";
         } else {
+            apply_index_changes();
             return {};
         }
     } else {
         db.rollback();
+        apply_index_changes();
         return {};
     }
 }
 
-std::optional<QList<schema::EhBackupImport>>
-DataStore::EhBakDbImport(QSqlDatabase *ehdb) {
-    QList<schema::EhBackupImport> ret;
-    QSqlQuery query{*ehdb};
-    QString sql = "SELECT downloads.gid as gid, token, title, title_jpn, thumb, "
-                  "category, posted, uploader, rating,"
-                  "       simple_language, state, legacy, time, label, dirname "
-                  "FROM downloads LEFT JOIN download_dirname "
-                  "ON downloads.gid == download_dirname.gid";
-    if (!query.exec(sql)) {
-        qCritical() << "failed to read ehdb: " << query.lastError();
-        return {};
-    }
-    while (query.next()) {
-        auto data = schema::EhBackupImport{
-            .gid = query.value("gid").toLongLong(),
-            .token = query.value("token").toString().toStdString(),
-            .title = query.value("title").toString().toStdString(),
-            .title_jpn = query.value("title_jpn").toString().toStdString(),
-            .thumb = query.value("thumb").toString().toStdString(),
-            .category =
-                EhentaiApi::CategoryFromEhViewerValue(query.value("category").toInt())
-                    .value_or(EhCategory::UNKNOWN),
-            .posted = query.value("posted").toString().toStdString(),
-            .uploader = query.value("uploader").toString().toStdString(),
-            .rating = query.value("rating").toDouble(),
-            .simple_language = query.value("simple_language").toString().toStdString(),
-            .state = query.value("state").toInt(),
-            .legacy = query.value("legacy").toInt(),
-            .time = query.value("time").toLongLong(),
-            .label = query.value("label").toString().toStdString(),
-            .dirname = query.value("dirname").toString().toStdString(),
-        };
-        if (data.gid <= 0 || data.dirname.empty()) {
-            qCritical() << "eh backup db data corrupt for gid=" << data.gid;
-            continue;
-        }
-        ret << data;
-    }
-    return ret;
-}
-
 std::optional<uint64_t> DataStore::SelectSingleNumber(QSqlQuery *query) {
     if (!query->exec())
         return {};
@@ -4,14 +4,19 @@
 #include <QDir>
 #include <QSettings>
 #include <QStringList>
+#include <QThreadPool>
 #include <QtSql>
+#include <atomic>
 #include <cinttypes>
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include "DatabaseSchema.h"
 #include "EhentaiApi.h"
 
+class SearchIndex;
+
 class DataStore {
   public:
     static const QString kEhDbViewerOrgName;
@@ -20,35 +25,85 @@ class DataStore {
 
     static QSettings GetSettings();
     static QString GetSqlitePath();
+    // the in-memory index used by DbSearch(), shared by the whole application
+    static SearchIndex &GetSearchIndex();
 
-    static std::optional<QSqlDatabase>
-    OpenDatabase(QString connection_name = kDefaultConnectionName);
+    // kDefaultConnectionName on the GUI thread, a name unique to the thread otherwise.
+    // A QSqlDatabase can only be used by the thread that opened it.
+    static QString ThreadConnectionName();
+    // Connections are pooled per thread: a null connection_name means the calling
+    // thread's connection, opened on first use in WAL mode, see ConfigureConnection().
+    static std::optional<QSqlDatabase> OpenDatabase(QString connection_name = QString());
+    // The calling thread's read-only connection. Readers never block the writer in WAL
+    // mode, and see a snapshot of the db for as long as they keep a transaction open.
+    static std::optional<QSqlDatabase> OpenReadConnection();
+    // Close the calling thread's connections, for threads that are about to exit.
+    // No copy of them may be in use anymore.
+    static void CloseThreadConnections();
+    // CloseThreadConnections() on every thread of an idle pool whose threads never
+    // expire, see QThreadPool::setExpiryTimeout(). Blocks until they are closed.
+    static void ClosePoolConnections(QThreadPool &pool);
     // force open a sqlite db file. i.e. delete the conn if the conn name exists
     static std::optional<QSqlDatabase> OpenDatabase(QString db_path, QString conn_name);
-    // create tables if they don't exists, return false if failure
-    static bool DbCreateTables(QSqlDatabase &db);
+    // Apply the pragmas used by pooled connections: WAL journal, synchronous=NORMAL,
+    // larger page cache, mmap and busy timeout. Return false if error.
+    static bool ConfigureConnection(QSqlDatabase &db, bool read_only);
+    // called before each migration step of a table
+    using MigrationProgress =
+        std::function<void(const QString &table_name, int64_t from_revision,
+                           int64_t to_revision)>;
+    // create tables if they don't exists and migrate them to the current revision,
+    // return false if failure
+    static bool DbCreateTables(QSqlDatabase &db, const MigrationProgress &progress = {});
 
     // return {} if error
     static std::optional<int64_t> DbMaxFid(QSqlDatabase &db);
     static std::optional<QSet<QString>> DbListAllFolders(QSqlDatabase &db);
-    static std::optional<QList<schema::FolderPreview>>
+    static std::optional<QVector<schema::FolderPreview>>
     DbListAllFolderPreviews(QSqlDatabase &db);
-    static std::optional<QMap<int64_t, QStringList>>
-    DbListSearchKeywords(QSqlDatabase &db);
+    // every folder with its search_docs row, ordered by fid
+    static std::optional<QList<schema::FolderSearchDoc>>
+    DbListSearchDocs(QSqlDatabase &db);
+    // same as above, but only for the given folders
+    static std::optional<QList<schema::FolderSearchDoc>>
+    DbQuerySearchDocs(QSqlDatabase &db, const std::vector<int64_t> &fids);
 
     // A result is included if it's matches all in include_kw and none in exclude_kw.
     // When include_kw is empty, then all results will be considered.
     // TODO match mode: regex vs wildcard
     // TODO compatible normalization
-    static std::optional<QList<schema::FolderPreview>>
-    DbSearch(QSqlDatabase &db, QStringList include_kw, QStringList exclude_kw);
+    // The searches stop early once *cancelled is set, the result is then meaningless.
+    static std::optional<QVector<schema::FolderPreview>>
+    DbSearch(QSqlDatabase &db, QStringList include_kw, QStringList exclude_kw,
+             const std::atomic<bool> *cancelled = nullptr);
     // Search all folders that are similar to `title`
-    static std::optional<QList<schema::FolderPreview>> DbSearchSimilar(QSqlDatabase &db,
-                                                                       QString title);
+    static std::optional<QVector<schema::FolderPreview>>
+    DbSearchSimilar(QSqlDatabase &db, QString title,
+                    const std::atomic<bool> *cancelled = nullptr);
+    // Folders with a near duplicate title, see DuplicateClusterer. The folders of a
+    // cluster are listed one after another.
+    static std::optional<QVector<schema::FolderPreview>>
+    DbFindDuplicates(QSqlDatabase &db, const std::atomic<bool> *cancelled = nullptr);
+    // hashes of covers this many bits apart at most are the same picture
+    static constexpr int kMaxCoverDistance = 3;
+    // Folders whose cover is visually identical to the one of `fid`, at most
+    // kMaxCoverDistance bits apart by ImageHash::DHash(). Closest first.
+    static std::optional<QVector<schema::FolderPreview>>
+    DbSearchSimilarCover(QSqlDatabase &db, int64_t fid);
+
+    // fingerprints of root and every folder below it
+    static std::optional<QList<schema::DirFingerprints>>
+    DbListDirFingerprints(QSqlDatabase &db, const QString &root);
+    // the subset of folder_paths that are in img_folders
+    static std::optional<QSet<QString>> DbListExistingFolders(QSqlDatabase &db,
+                                                              const QStringList &paths);
 
     // querys, return {} if error
     static std::optional<schema::CoverImages> DbQueryCoverImages(QSqlDatabase &db,
                                                                  int64_t fid);
+    // thumbnails by fid, folders without a cover are missing in the result
+    static std::optional<QHash<int64_t, QByteArray>>
+    DbQueryCovers(QSqlDatabase &db, const std::vector<int64_t> &fids);
     static std::optional<schema::EhentaiMetadata> DbQueryEhMetaByGid(QSqlDatabase &db,
                                                                      QString gid);
     static std::optional<schema::EhentaiMetadata> DbQueryEhMetaByFid(QSqlDatabase &db,
@@ -59,18 +114,45 @@ class DataStore {
     static bool DbInsert(QSqlDatabase &db, schema::ImageFolders data);
     static bool DbInsert(QSqlDatabase &db, schema::CoverImages data);
     static bool DbInsert(QSqlDatabase &db, schema::EhentaiMetadata data);
+    // Insert all rows with a single prepared statement, which is far cheaper than a
+    // DbInsert() per row. Should run in a transaction, a failure leaves the rows before
+    // the failing one inserted. Return false if error.
+    static bool DbBulkInsert(QSqlDatabase &db,
+                             const std::vector<schema::ImageFolders> &rows);
+    static bool DbBulkInsert(QSqlDatabase &db,
+                             const std::vector<schema::CoverImages> &rows);
+    static bool DbBulkInsert(QSqlDatabase &db,
+                             const std::vector<schema::EhentaiMetadata> &rows);
     // require the caller to warp db in a transaction.
     static bool DbInsertReqTransaction(QSqlDatabase &db, const EhGalleryMetadata &data);
     static bool DbReplaceEhTagsReqTransaction(QSqlDatabase &db, QString gid,
                                               QStringList tags);
+    // Rebuild the search_docs rows of the given folders. folder_tags has no triggers,
+    // its writers call this once they're done with a folder's tags.
+    static bool DbRefreshSearchDocsReqTransaction(QSqlDatabase &db,
+                                                  const std::vector<int64_t> &fids);
+    // Delete the folders at the given paths with their covers and tags, paths that are
+    // not in img_folders are ignored. Return the number of folders deleted.
+    static std::optional<int64_t>
+    DbDeleteFoldersReqTransaction(QSqlDatabase &db, const QStringList &folder_paths);
+    // The unfinished run of the import of `source` if any, a new run otherwise.
+    static std::optional<schema::ImportJournal>
+    DbBeginImport(QSqlDatabase &db, const QString &kind, const QString &source);
+    // count `imported` more folders to the run, then mark it finished if `finished`
+    static bool DbUpdateImportJournalReqTransaction(QSqlDatabase &db, int64_t id,
+                                                    int64_t imported, bool finished);
+    // upsert `listed`, delete `removed_paths`
+    static bool DbUpdateDirFingerprintsReqTransaction(
+        QSqlDatabase &db, const std::vector<schema::DirFingerprints> &listed,
+        const QStringList &removed_paths);
 
     // the inner function should return true if need submission, or false for rollback
     // the function returns a string if anything is wrong with the transaction.
+    // Pending search index changes are applied when the transaction finishes.
+    // Write transactions are serialized, only one thread writes at a time.
     static std::optional<QString>
     DbTransaction(std::function<bool(QSqlDatabase *db)> f,
-                  QString connection_name = kDefaultConnectionName);
-
-    static std::optional<QList<schema::EhBackupImport>> EhBakDbImport(QSqlDatabase *ehdb);
+                  QString connection_name = QString());
 
     //
     // Helper functions
@@ -1,13 +1,26 @@
 #ifndef DATABASESCHEMA_H
 #define DATABASESCHEMA_H
 
+#include <QByteArray>
 #include <QString>
+#include <QStringList>
 #include <cinttypes>
+#include <optional>
+#include <tuple>
 
 #include "EhentaiApi.h"
 
 namespace schema {
 
+// A column and the member it's stored in. Fields() of a schema lists them in column
+// order, SchemaCodec.h generates the column lists and row codecs from it.
+template <typename Row, typename T> struct Field {
+    const char *name;
+    T Row::*member;
+
+    constexpr Field(const char *name, T Row::*member) : name(name), member(member) {}
+};
+
 struct TableRevision {
     QString table_name;
     int64_t revision;
@@ -30,7 +43,14 @@ struct ImageFolders {
     int64_t record_time;
     QString eh_gid;
 
-    static int SchemaRevision() { return 1; }
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"fid", &ImageFolders::fid},
+                               Field{"folder_path", &ImageFolders::folder_path},
+                               Field{"title", &ImageFolders::title},
+                               Field{"record_time", &ImageFolders::record_time},
+                               Field{"eh_gid", &ImageFolders::eh_gid});
+    }
+    static int SchemaRevision() { return 2; }
     static QString TableName() { return "img_folders"; }
     static QString CreationSql() {
         return R"_SQL_(
@@ -43,14 +63,31 @@ struct ImageFolders {
         )
         )_SQL_";
     }
+    // statements that upgrade the table from `from_revision` to the next revision,
+    // nullopt if there is no such step
+    static std::optional<QStringList> MigrationSql(int from_revision) {
+        switch (from_revision) {
+        case 1: // joins with ehentai_metadata and ehentai_tags
+            return QStringList{
+                "create index if not exists img_folders_eh_gid on img_folders(eh_gid)"};
+        default:
+            return std::nullopt;
+        }
+    }
 };
 
 struct CoverImages {
     int64_t fid;
     QString cover_fname;
-    QString cover_base64;
+    QByteArray cover; // thumbnail file content, usually jpeg
 
-    static int SchemaRevision() { return 1; }
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"fid", &CoverImages::fid},
+                               Field{"cover_fname", &CoverImages::cover_fname},
+                               Field{"cover", &CoverImages::cover});
+    }
+    // revision 2: cover_base64 text replaced by cover blob, fid becomes the primary key
+    static int SchemaRevision() { return 2; }
     static QString TableName() { return "cover_images"; }
     static QString CreationSql() {
         return R"_SQL_(
@@ -68,7 +105,12 @@ struct FolderTags {
     QString ns;
     QString stem;
 
-    static int SchemaRevision() { return 1; }
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"fid", &FolderTags::fid},
+                               Field{"namespace", &FolderTags::ns},
+                               Field{"stem", &FolderTags::stem});
+    }
+    static int SchemaRevision() { return 2; }
     static QString TableName() { return "folder_tags"; }
     static QString CreationSql() {
         return R"_SQL_(
@@ -79,6 +121,15 @@ struct FolderTags {
         )
         )_SQL_";
     }
+    static std::optional<QStringList> MigrationSql(int from_revision) {
+        switch (from_revision) {
+        case 1:
+            return QStringList{
+                "create index if not exists folder_tags_fid on folder_tags(fid)"};
+        default:
+            return std::nullopt;
+        }
+    }
 };
 
 // exactly the same as table ehentai_metadata
@@ -100,6 +151,21 @@ struct EhentaiMetadata {
     qlonglong
         meta_updated; // unix timestamp, second, when does the data for this gid is pull
 
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"gid", &EhentaiMetadata::gid},
+                               Field{"token", &EhentaiMetadata::token},
+                               Field{"title", &EhentaiMetadata::title},
+                               Field{"title_jpn", &EhentaiMetadata::title_jpn},
+                               Field{"category", &EhentaiMetadata::category},
+                               Field{"thumb", &EhentaiMetadata::thumb},
+                               Field{"uploader", &EhentaiMetadata::uploader},
+                               Field{"posted", &EhentaiMetadata::posted},
+                               Field{"filecount", &EhentaiMetadata::filecount},
+                               Field{"filesize", &EhentaiMetadata::filesize},
+                               Field{"expunged", &EhentaiMetadata::expunged},
+                               Field{"rating", &EhentaiMetadata::rating},
+                               Field{"meta_updated", &EhentaiMetadata::meta_updated});
+    }
     static int SchemaRevision() { return 1; }
     static QString TableName() { return "ehentai_metadata"; }
     static QString CreationSql() {
@@ -127,7 +193,11 @@ struct EhentaiTags {
     QString gid;
     QString tag;
 
-    static int SchemaRevision() { return 1; }
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"gid", &EhentaiTags::gid},
+                               Field{"tag", &EhentaiTags::tag});
+    }
+    static int SchemaRevision() { return 2; }
     static QString TableName() { return "ehentai_tags"; }
     static QString CreationSql() {
         return R"_SQL_(
@@ -137,38 +207,390 @@ struct EhentaiTags {
         )
         )_SQL_";
     }
+    static std::optional<QStringList> MigrationSql(int from_revision) {
+        switch (from_revision) {
+        case 1:
+            return QStringList{
+                "create index if not exists ehentai_tags_gid on ehentai_tags(gid)"};
+        default:
+            return std::nullopt;
+        }
+    }
 };
 
-// represent a search result, used for display and quick preview
+// One row per folder with everything it can be searched by: its title, the eh titles,
+// and the eh tags plus "namespace:stem" of folder tags in `tags`, one per line.
+// Maintained by triggers on img_folders and ehentai_metadata and by the tag writers,
+// it's the content table of search_fts and what the in-memory search index loads.
+// Replaces search_keywords, which had a row per keyword and was rebuilt by a union
+// of joins.
+struct SearchDocs {
+    int64_t fid;
+    QString title;
+    QString eh_title;     // empty if no eh data
+    QString eh_title_jpn; // empty if no eh data or no jpn title
+    QString tags;         // separated by '\n'
+
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"fid", &SearchDocs::fid},
+                               Field{"title", &SearchDocs::title},
+                               Field{"eh_title", &SearchDocs::eh_title},
+                               Field{"eh_title_jpn", &SearchDocs::eh_title_jpn},
+                               Field{"tags", &SearchDocs::tags});
+    }
+    static int SchemaRevision() { return 1; }
+    static QString TableName() { return "search_docs"; }
+    static QString CreationSql() {
+        return R"_SQL_(
+        create table if not exists search_docs(
+            fid integer primary key,    -- foreign key for img_folders.fid
+            title text not null,
+            eh_title text not null,
+            eh_title_jpn text not null,
+            tags text not null          -- one per line, no empty line
+        )
+        )_SQL_";
+    }
+
+    // Select the documents of folders matching `where`, in the column order of Fields().
+    // `where` filters img_folders, which is aliased as "if", e.g. "WHERE if.fid=1"
+    static QString SelectSql(const QString &where) {
+        QString sql = R"_SQL_(
+        SELECT if.fid, if.title, coalesce(em.title, ''), coalesce(em.title_jpn, ''),
+            trim(coalesce((SELECT group_concat(tag, char(10)) FROM ehentai_tags AS et
+                           WHERE et.gid == if.eh_gid AND et.tag != ''), '')
+                 || char(10) ||
+                 coalesce((SELECT group_concat(namespace||':'||stem, char(10))
+                           FROM folder_tags AS ft WHERE ft.fid == if.fid), ''),
+                 char(10))
+        FROM img_folders AS if LEFT JOIN ehentai_metadata AS em ON if.eh_gid == em.gid %1
+        )_SQL_";
+        return sql.arg(where);
+    }
+
+    // Replace the documents of folders matching `where`, two statements. `where` is the
+    // same as in SelectSql(), its placeholders are bound once per statement.
+    static QStringList RefreshSql(const QString &where) {
+        return {QString("DELETE FROM search_docs WHERE fid IN "
+                        "(SELECT fid FROM img_folders AS if %1)")
+                    .arg(where),
+                "INSERT INTO search_docs " + SelectSql(where)};
+    }
+
+    // Indexes, triggers and initial data, one statement per string.
+    // Tags have no triggers: a gallery's tags are replaced one row at a time, so the
+    // writers of folder_tags and ehentai_tags call RefreshSql() once when they're done.
+    static QStringList PostCreationSql() {
+        auto refresh = [](const QString &where) {
+            return RefreshSql(where).join(';') + ';';
+        };
+        auto trigger = [](const QString &name, const QString &event,
+                          const QString &body) {
+            return QString("create trigger if not exists %1 after %2 begin %3 end")
+                .arg(name, event, body);
+        };
+        QString by_new_fid = "WHERE if.fid = new.fid";
+        QString by_new_gid = "WHERE if.eh_gid = new.gid";
+        QString by_old_gid = "WHERE if.eh_gid = old.gid";
+        QStringList ret;
+        // search_keywords and the search_fts built on it are superseded, search_fts is
+        // created again over search_docs
+        for (const char *source : {"img_folders", "folder_tags", "ehentai_metadata",
+                                   "ehentai_tags"}) {
+            for (const char *event : {"ai", "au", "ad"})
+                ret << QString("drop trigger if exists search_keywords_%1_%2")
+                           .arg(source, event);
+        }
+        ret << "drop table if exists search_fts"
+            << "drop table if exists search_keywords"
+            << "delete from table_revision "
+               "where table_name in ('search_fts', 'search_keywords')";
+        ret << trigger("search_docs_img_folders_ai", "insert on img_folders",
+                       refresh(by_new_fid))
+            << trigger("search_docs_img_folders_au", "update on img_folders",
+                       refresh(by_new_fid))
+            << trigger("search_docs_img_folders_ad", "delete on img_folders",
+                       "DELETE FROM search_docs WHERE fid = old.fid;")
+            << trigger("search_docs_ehentai_metadata_ai", "insert on ehentai_metadata",
+                       refresh(by_new_gid))
+            << trigger("search_docs_ehentai_metadata_au", "update on ehentai_metadata",
+                       refresh(by_new_gid))
+            << trigger("search_docs_ehentai_metadata_ad", "delete on ehentai_metadata",
+                       refresh(by_old_gid))
+            << "INSERT INTO search_docs " + SelectSql("");
+        return ret;
+    }
+};
+
+// Trigram full text index over search_docs, answers substring searches. The rowid is
+// the fid. A term can't match across two tags, it would have to contain the '\n'.
+// Optional: needs sqlite 3.34+ built with fts5.
+struct SearchFts {
+    int64_t rowid; // search_docs.fid
+    QString title;
+    QString eh_title;
+    QString eh_title_jpn;
+    QString tags;
+
+    static int SchemaRevision() { return 1; }
+    static QString TableName() { return "search_fts"; }
+    static QString CreationSql() {
+        return R"_SQL_(
+        create virtual table if not exists search_fts using fts5(
+            title, eh_title, eh_title_jpn, tags,
+            content = 'search_docs',
+            content_rowid = 'fid',
+            tokenize = 'trigram'
+        )
+        )_SQL_";
+    }
+    // search_docs rows are only ever inserted and deleted
+    static QStringList PostCreationSql() {
+        return {
+            R"_SQL_(
+            create trigger if not exists search_fts_ai after insert on search_docs begin
+                insert into search_fts(rowid, title, eh_title, eh_title_jpn, tags)
+                values (new.fid, new.title, new.eh_title, new.eh_title_jpn, new.tags);
+            end
+            )_SQL_",
+            R"_SQL_(
+            create trigger if not exists search_fts_ad after delete on search_docs begin
+                insert into search_fts(search_fts, rowid, title, eh_title, eh_title_jpn, tags)
+                values ('delete', old.fid, old.title, old.eh_title, old.eh_title_jpn, old.tags);
+            end
+            )_SQL_",
+            "insert into search_fts(search_fts) values ('rebuild')",
+        };
+    }
+};
+
+// Fingerprint of every folder listed by DataImporter::ScanFolder(). A rescan only lists
+// the folders whose fingerprint changed, the others are only stat()ed.
+struct DirFingerprints {
+    QString path;   // absolute
+    QString parent; // path of the parent folder
+    int64_t inode;
+    int64_t mtime_ns;
+    int64_t entry_count;
+    QString cover_fname; // empty if the folder has no image
+    int64_t scanned_at;  // unix timestamp second
+
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"path", &DirFingerprints::path},
+                               Field{"parent", &DirFingerprints::parent},
+                               Field{"inode", &DirFingerprints::inode},
+                               Field{"mtime_ns", &DirFingerprints::mtime_ns},
+                               Field{"entry_count", &DirFingerprints::entry_count},
+                               Field{"cover_fname", &DirFingerprints::cover_fname},
+                               Field{"scanned_at", &DirFingerprints::scanned_at});
+    }
+    static int SchemaRevision() { return 1; }
+    static QString TableName() { return "dir_fingerprints"; }
+    static QString CreationSql() {
+        return R"_SQL_(
+        create table if not exists dir_fingerprints(
+            path text primary key,
+            parent text not null,
+            inode integer not null,         -- 0 if unknown
+            mtime_ns integer not null,      -- mtime of the folder itself, changes when an entry is added or removed
+            entry_count integer not null,   -- non hidden entries
+            cover_fname text not null,
+            scanned_at integer not null     -- unix timestamp second: when was the folder listed
+        )
+        )_SQL_";
+    }
+};
+
+// One row per import run. Imports commit in chunks, an interrupted import leaves its
+// row unfinished and the next import of the same source resumes it.
+struct ImportJournal {
+    int64_t id;
+    QString kind;   // "folder" or "ehviewer_backup"
+    QString source; // what is imported, the same string for every run of an import
+    int64_t started_at;
+    int64_t updated_at;
+    int64_t imported;    // folders committed so far
+    int64_t finished_at; // 0 while running or interrupted
+
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"id", &ImportJournal::id},
+                               Field{"kind", &ImportJournal::kind},
+                               Field{"source", &ImportJournal::source},
+                               Field{"started_at", &ImportJournal::started_at},
+                               Field{"updated_at", &ImportJournal::updated_at},
+                               Field{"imported", &ImportJournal::imported},
+                               Field{"finished_at", &ImportJournal::finished_at});
+    }
+    static int SchemaRevision() { return 1; }
+    static QString TableName() { return "import_journal"; }
+    static QString CreationSql() {
+        return R"_SQL_(
+        create table if not exists import_journal(
+            id integer primary key,
+            kind text not null,
+            source text not null,
+            started_at integer not null,    -- unix timestamp second
+            updated_at integer not null,    -- unix timestamp second: when was the last chunk committed
+            imported integer not null,
+            finished_at integer not null    -- unix timestamp second, 0 if not finished
+        )
+        )_SQL_";
+    }
+};
+
+// Titles in the form similar_to: compares them in, see FuzzSearcher::parseTitle().
+// The normalization is a unicode pass too slow to repeat over the library for every
+// query. Written along with img_folders by DataStore::DbBulkInsert(), a row whose
+// `title` isn't the folder's title anymore is stale.
+struct TitleNorms {
+    int64_t fid;
+    QString title;      // img_folders.title the row was computed from
+    QString normalized; // FuzzSearcher::NormalizeTitle() of the title
+
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"fid", &TitleNorms::fid},
+                               Field{"title", &TitleNorms::title},
+                               Field{"normalized", &TitleNorms::normalized});
+    }
+    // revision 2: filled for the folders imported before the table existed
+    static int SchemaRevision() { return 2; }
+    static QString TableName() { return "title_norms"; }
+    static QString CreationSql() {
+        return R"_SQL_(
+        create table if not exists title_norms(
+            fid integer primary key,    -- foreign key for img_folders.fid
+            title text not null,
+            normalized text not null
+        )
+        )_SQL_";
+    }
+    static QStringList PostCreationSql() {
+        return {"create trigger if not exists title_norms_img_folders_ad "
+                "after delete on img_folders begin "
+                "DELETE FROM title_norms WHERE fid = old.fid; end"};
+    }
+};
+
+// Inverted index of the title_norms trigrams, see FuzzSearcher::candidateGrams().
+// Postings are only ever added: a deleted folder or an older title leaves its fid
+// behind, so a posting list is a superset of the folders having the trigram.
+struct TitleGrams {
+    int64_t gram;    // FuzzSearcher::TitleGrams() packed trigram
+    QByteArray fids; // PostingList::Encode() of the fids
+
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"gram", &TitleGrams::gram},
+                               Field{"fids", &TitleGrams::fids});
+    }
+    // revision 2: built from the title_norms rows written before the table existed
+    static int SchemaRevision() { return 2; }
+    static QString TableName() { return "title_grams"; }
+    static QString CreationSql() {
+        return R"_SQL_(
+        create table if not exists title_grams(
+            gram integer primary key,
+            fids blob not null
+        )
+        )_SQL_";
+    }
+};
+
+// dHash of every cover, see ImageHash. The hash is also split into four 16 bit blocks,
+// each with an index: two hashes at most 3 bits apart have a block in common, so the
+// near hashes of a cover are found by four index lookups (multi-index hashing).
+struct CoverHashes {
+    int64_t fid;
+    int64_t dhash;  // ImageHash::DHash() of cover_images.cover, as a signed integer
+    int64_t block0; // bits 0-15 of the hash
+    int64_t block1; // bits 16-31
+    int64_t block2; // bits 32-47
+    int64_t block3; // bits 48-63
+
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"fid", &CoverHashes::fid},
+                               Field{"dhash", &CoverHashes::dhash},
+                               Field{"block0", &CoverHashes::block0},
+                               Field{"block1", &CoverHashes::block1},
+                               Field{"block2", &CoverHashes::block2},
+                               Field{"block3", &CoverHashes::block3});
+    }
+    // revision 2: filled for the covers imported before the table existed
+    static int SchemaRevision() { return 2; }
+    static QString TableName() { return "cover_hashes"; }
+    static QString CreationSql() {
+        return R"_SQL_(
+        create table if not exists cover_hashes(
+            fid integer primary key,    -- foreign key for cover_images.fid
+            dhash integer not null,
+            block0 integer not null,
+            block1 integer not null,
+            block2 integer not null,
+            block3 integer not null
+        )
+        )_SQL_";
+    }
+    static QStringList PostCreationSql() {
+        return {"create index if not exists cover_hashes_block0 on cover_hashes(block0)",
+                "create index if not exists cover_hashes_block1 on cover_hashes(block1)",
+                "create index if not exists cover_hashes_block2 on cover_hashes(block2)",
+                "create index if not exists cover_hashes_block3 on cover_hashes(block3)",
+                CoverImagesTriggerSql()};
+    }
+    // Deletes the hash along with the cover. A trigger goes away with its table, so
+    // this is created again whenever cover_images is rebuilt.
+    static QString CoverImagesTriggerSql() {
+        return "create trigger if not exists cover_hashes_cover_images_ad "
+               "after delete on cover_images begin "
+               "DELETE FROM cover_hashes WHERE fid = old.fid; end";
+    }
+};
+
+// represent a search result, used for display.
+// Thumbnails are not included, fetch them with DataStore::DbQueryCovers() when needed.
 struct FolderPreview {
     int64_t fid;
     QString folder_path;
     QString title;
     int64_t record_time;
-    QString cover_base64;
     QString eh_gid;
+
+    // a projection of img_folders
+    static QString TableName() { return "img_folders"; }
+    static constexpr auto Fields() {
+        return std::make_tuple(Field{"fid", &FolderPreview::fid},
+                               Field{"folder_path", &FolderPreview::folder_path},
+                               Field{"title", &FolderPreview::title},
+                               Field{"record_time", &FolderPreview::record_time},
+                               Field{"eh_gid", &FolderPreview::eh_gid});
+    }
+};
+
+// a folder with its search document, what the in-memory search index holds
+struct FolderSearchDoc {
+    ImageFolders folder;
+    SearchDocs doc;
 };
 
 struct EhBackupImport {
     // DOWNLOADS table
     int64_t gid;
-    std::string token;
-    std::string title;
-    std::string title_jpn;
-    std::string thumb;
+    QString token;
+    QString title;
+    QString title_jpn;
+    QString thumb;
     // https://github.com/seven332/EhViewer/blob/master/app/src/main/java/com/hippo/ehviewer/client/EhConfig.java#L282
     // EhViewer uses bitfields
     EhCategory category;
-    std::string posted; // e.g. 2008-04-06 18:13
-    std::string uploader;
+    QString posted; // e.g. 2008-04-06 18:13
+    QString uploader;
     double rating;
-    std::string simple_language;
+    QString simple_language;
     int64_t state;
     int64_t legacy;
     int64_t time;
-    std::string label;
+    QString label;
     // DOWNLOAD_DIRNAME table
-    std::string dirname;
+    QString dirname;
 };
 
 } // namespace schema
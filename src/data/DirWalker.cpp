@@ -0,0 +1,210 @@
+#include "DirWalker.h"
+
+#include <QDebug>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtConcurrent>
+#include <algorithm>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+bool IsImageName(const QString &name) {
+    int dot = name.lastIndexOf('.');
+    if (dot < 0)
+        return false;
+    QStringRef ext = name.midRef(dot + 1);
+    return ext.compare(QLatin1String("jpg"), Qt::CaseInsensitive) == 0 ||
+           ext.compare(QLatin1String("png"), Qt::CaseInsensitive) == 0 ||
+           ext.compare(QLatin1String("jpeg"), Qt::CaseInsensitive) == 0;
+}
+
+// keep the image that QDir::Name | QDir::IgnoreCase would list first
+void OfferCover(const QString &name, QString *cover) {
+    if (cover->isEmpty() || QString::compare(name, *cover, Qt::CaseInsensitive) < 0)
+        *cover = name;
+}
+
+// return false if path can't be stat()ed, e.g. it was removed
+bool ReadFingerprint(const QString &path, DirWalker::Fingerprint *out) {
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0)
+        return false;
+#ifdef Q_OS_DARWIN
+    const timespec &mtime = st.st_mtimespec;
+#else
+    const timespec &mtime = st.st_mtim;
+#endif
+    out->inode = st.st_ino;
+    out->mtime_ns = int64_t(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+    return true;
+#else
+    QFileInfo info{path};
+    if (!info.exists())
+        return false;
+    out->inode = 0;
+    out->mtime_ns = info.lastModified().toMSecsSinceEpoch() * 1000000;
+    return true;
+#endif
+}
+
+// nullopt if the folder can't be listed, e.g. EACCES or EIO
+std::optional<DirWalker::Listing> ListDir(const QString &path, bool stop_at_first_image) {
+    DirWalker::Listing ret{{}, {}, 0};
+#ifdef Q_OS_UNIX
+    const QByteArray native_path = QFile::encodeName(path);
+    const QString prefix = path.endsWith('/') ? path : path + '/';
+    DIR *dir = opendir(native_path.constData());
+    if (dir == nullptr) {
+        qWarning() << "DirWalker: failed to list" << path;
+        return {};
+    }
+    while (const dirent *entry = readdir(dir)) {
+        const char *name = entry->d_name;
+        if (name[0] == '.') // hidden, "." and ".."
+            continue;
+        ret.entry_count++;
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            // some file systems don't fill d_type, and links are followed like QDir does
+            struct stat st;
+            QByteArray full_path = QFile::encodeName(prefix) + name;
+            if (stat(full_path.constData(), &st) != 0)
+                continue;
+            if (S_ISDIR(st.st_mode))
+                type = DT_DIR;
+            else if (S_ISREG(st.st_mode))
+                type = DT_REG;
+            else
+                continue;
+        }
+        if (type == DT_DIR) {
+            ret.subdirs << prefix + QFile::decodeName(name);
+        } else if (type == DT_REG) {
+            QString fname = QFile::decodeName(name);
+            if (IsImageName(fname)) {
+                OfferCover(fname, &ret.cover_fname);
+                if (stop_at_first_image)
+                    break;
+            }
+        }
+    }
+    closedir(dir);
+#else
+    if (!QFileInfo(path).isReadable()) {
+        qWarning() << "DirWalker: failed to list" << path;
+        return {};
+    }
+    // the native iterator already knows the entry types, fileInfo() doesn't stat again
+    QDirIterator it(path, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        ret.entry_count++;
+        const QFileInfo info = it.fileInfo();
+        if (info.isDir()) {
+            ret.subdirs << info.absoluteFilePath();
+        } else if (IsImageName(info.fileName())) {
+            OfferCover(info.fileName(), &ret.cover_fname);
+            if (stop_at_first_image)
+                break;
+        }
+    }
+#endif
+    return ret;
+}
+} // namespace
+
+DirWalker::DirWalker(int thread_count) : thread_count_(std::max(1, thread_count)) {}
+
+void DirWalker::setStopAtFirstImage(bool stop) { stop_at_first_image_ = stop; }
+
+void DirWalker::setListingCache(ListingCache cache, ListedSink on_listed) {
+    cache_ = std::move(cache);
+    on_listed_ = std::move(on_listed);
+}
+
+int64_t DirWalker::dirsListed() const { return dirs_listed_; }
+
+int64_t DirWalker::dirsFromCache() const { return dirs_from_cache_; }
+
+QStringList DirWalker::failedDirs() const { return failed_dirs_; }
+
+bool DirWalker::walk(const QString &root, const Sink &sink) {
+    dirs_listed_ = 0;
+    dirs_from_cache_ = 0;
+    failed_dirs_.clear();
+
+    QMutex mutex;
+    QWaitCondition changed;
+    // LIFO: depth first, keeps the list short on wide trees
+    std::vector<QString> todo{QFileInfo(root).absoluteFilePath()};
+    int listing = 0; // folders being listed
+    bool stopped = false;
+
+    auto worker = [&] {
+        QMutexLocker locker(&mutex);
+        while (true) {
+            while (!stopped && todo.empty() && listing > 0)
+                changed.wait(&mutex);
+            if (stopped || todo.empty())
+                break;
+            QString path = std::move(todo.back());
+            todo.pop_back();
+            listing++;
+            locker.unlock();
+
+            Listing dir{{}, {}, 0};
+            bool keep_going = true;
+            bool failed = false;
+            Fingerprint fingerprint{0, 0};
+            std::optional<Listing> cached;
+            bool exists = !cache_ || ReadFingerprint(path, &fingerprint);
+            if (cache_ && exists)
+                cached = cache_(path, fingerprint);
+            if (cached) {
+                dir = std::move(*cached);
+                dirs_from_cache_++;
+            } else if (exists) {
+                std::optional<Listing> listed = ListDir(path, stop_at_first_image_);
+                if (listed) {
+                    dir = std::move(*listed);
+                    dirs_listed_++;
+                    if (on_listed_)
+                        on_listed_(path, fingerprint, dir);
+                    if (!dir.cover_fname.isEmpty())
+                        keep_going = sink({path, dir.cover_fname});
+                } else {
+                    failed = true;
+                }
+            }
+
+            locker.relock();
+            listing--;
+            if (failed)
+                failed_dirs_ << path;
+            if (!keep_going)
+                stopped = true;
+            for (QString &subdir : dir.subdirs)
+                todo.push_back(std::move(subdir));
+            changed.wakeAll();
+        }
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(thread_count_ - 1);
+    for (int i = 1; i < thread_count_; i++)
+        QtConcurrent::run(&pool, worker);
+    worker();
+    pool.waitForDone();
+    return !stopped;
+}
@@ -0,0 +1,76 @@
+#ifndef DIRWALKER_H
+#define DIRWALKER_H
+
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <cinttypes>
+#include <functional>
+#include <optional>
+
+// Walks a directory tree looking for folders that contain images.
+// Only names and entry types are read (readdir and d_type on unix), files are never
+// stat()ed. Directories are listed by several threads at once, which hides the
+// latency of network file systems.
+class DirWalker {
+  public:
+    struct ImageFolder {
+        QString path; // absolute
+        QString cover_fname;
+    };
+    // Called from the walker threads, must be thread safe. Return false to stop.
+    using Sink = std::function<bool(const ImageFolder &folder)>;
+
+    // Changes whenever an entry is added to, removed from or renamed in the folder.
+    struct Fingerprint {
+        int64_t inode;    // 0 if unknown
+        int64_t mtime_ns; // of the folder itself
+    };
+    struct Listing {
+        QString cover_fname; // empty if no image
+        QStringList subdirs; // absolute paths
+        int64_t entry_count; // non hidden entries
+    };
+    // Return the listing recorded by an earlier walk if it's still valid for the
+    // current fingerprint, so the folder isn't listed again. Thread safe.
+    using ListingCache =
+        std::function<std::optional<Listing>(const QString &path, const Fingerprint &)>;
+    // Called for every folder that is actually listed. Folders that exist but can't be
+    // listed (no permission, I/O error) are not passed here, see failedDirs(). Thread safe.
+    using ListedSink = std::function<void(const QString &path, const Fingerprint &,
+                                          const Listing &)>;
+
+    explicit DirWalker(int thread_count = 4);
+
+    // Stop listing a folder at its first image, which becomes the cover.
+    // Faster on huge folders, but the cover is then whichever image the file system
+    // lists first, and subfolders listed after it are not visited.
+    // By default the whole folder is listed and the first image by name is the cover.
+    void setStopAtFirstImage(bool stop);
+    // Fingerprint every folder and ask `cache` before listing it. Folders answered by
+    // the cache are not passed to walk()'s sink, their subfolders are still visited.
+    // Folders that vanished before they could be fingerprinted are skipped.
+    void setListingCache(ListingCache cache, ListedSink on_listed);
+
+    // Call sink for every folder under root (included) that contains a jpg or png.
+    // Hidden entries are skipped. Folders are visited in no particular order.
+    // Return false if stopped by sink.
+    bool walk(const QString &root, const Sink &sink);
+
+    // statistics of the last walk()
+    int64_t dirsListed() const;
+    int64_t dirsFromCache() const;
+    // folders that exist but couldn't be listed, their subfolders were not visited
+    QStringList failedDirs() const;
+
+  private:
+    int thread_count_;
+    bool stop_at_first_image_ = false;
+    ListingCache cache_;
+    ListedSink on_listed_;
+    std::atomic<int64_t> dirs_listed_{0};
+    std::atomic<int64_t> dirs_from_cache_{0};
+    QStringList failed_dirs_;
+};
+
+#endif // DIRWALKER_H
@@ -0,0 +1,113 @@
+#include "EhBackupReader.h"
+
+#include <QDebug>
+#include <QSqlDatabase>
+#include <QSqlError>
+
+#include "DataStore.h"
+
+EhBackupReader::EhBackupReader(QStringList db_files) : db_files_(std::move(db_files)) {}
+
+EhBackupReader::~EhBackupReader() {
+    for (Cursor &cursor : cursors_) {
+        // the query must go before its connection
+        cursor.query.reset();
+        QSqlDatabase::database(cursor.connection_name, false).close();
+        QSqlDatabase::removeDatabase(cursor.connection_name);
+    }
+}
+
+std::optional<QString> EhBackupReader::open() {
+    // unique per reader, several imports may run at once
+    const QString name_prefix =
+        QString("ehviewer-backup-%1-").arg(reinterpret_cast<quintptr>(this));
+    for (int i = 0; i < db_files_.size(); i++) {
+        Cursor cursor{name_prefix + QString::number(i), db_files_[i], nullptr, {}};
+        auto db = DataStore::OpenDatabase(cursor.db_file, cursor.connection_name);
+        if (!db) {
+            cursors_.push_back(std::move(cursor));
+            error_ = "failed to open eh db file " + db_files_[i];
+            return error_;
+        }
+        cursor.query = std::make_unique<QSqlQuery>(*db);
+        cursor.query->setForwardOnly(true);
+        // gid is the primary key of both tables, the order costs nothing
+        if (!cursor.query->exec("SELECT downloads.gid, token, title, title_jpn, thumb, "
+                                "category, posted, uploader, rating, simple_language, "
+                                "state, legacy, time, label, dirname "
+                                "FROM downloads LEFT JOIN download_dirname "
+                                "ON downloads.gid == download_dirname.gid "
+                                "ORDER BY downloads.gid")) {
+            qCritical() << "failed to read ehdb: " << cursor.query->lastError();
+            cursors_.push_back(std::move(cursor));
+            error_ = "failed to read eh db file " + db_files_[i];
+            return error_;
+        }
+        cursors_.push_back(std::move(cursor));
+        if (!advance(&cursors_.back()))
+            return error_;
+    }
+    return {};
+}
+
+bool EhBackupReader::advance(Cursor *cursor) {
+    QSqlQuery &query = *cursor->query;
+    while (query.next()) {
+        schema::EhBackupImport data{
+            .gid = query.value(0).toLongLong(),
+            .token = query.value(1).toString(),
+            .title = query.value(2).toString(),
+            .title_jpn = query.value(3).toString(),
+            .thumb = query.value(4).toString(),
+            .category = EhentaiApi::CategoryFromEhViewerValue(query.value(5).toInt())
+                            .value_or(EhCategory::UNKNOWN),
+            .posted = query.value(6).toString(),
+            .uploader = query.value(7).toString(),
+            .rating = query.value(8).toDouble(),
+            .simple_language = query.value(9).toString(),
+            .state = query.value(10).toLongLong(),
+            .legacy = query.value(11).toLongLong(),
+            .time = query.value(12).toLongLong(),
+            .label = query.value(13).toString(),
+            .dirname = query.value(14).toString(),
+        };
+        if (data.gid <= 0 || data.dirname.isEmpty()) {
+            qCritical() << "eh backup db data corrupt for gid=" << data.gid;
+            continue;
+        }
+        cursor->current = std::move(data);
+        return true;
+    }
+    cursor->current.reset();
+    if (query.lastError().isValid()) {
+        qCritical() << "failed to read ehdb: " << query.lastError();
+        error_ = "failed to read eh db file " + cursor->db_file;
+        return false;
+    }
+    return true;
+}
+
+std::optional<schema::EhBackupImport> EhBackupReader::next() {
+    if (error_)
+        return {};
+    // a handful of backups at most, a linear scan beats a heap
+    Cursor *winner = nullptr;
+    for (Cursor &cursor : cursors_) {
+        // `<=`: the later db wins a tie
+        if (cursor.current && (!winner || cursor.current->gid <= winner->current->gid))
+            winner = &cursor;
+    }
+    if (winner == nullptr)
+        return {};
+
+    schema::EhBackupImport ret = std::move(*winner->current);
+    for (Cursor &cursor : cursors_) {
+        if (&cursor == winner || (cursor.current && cursor.current->gid == ret.gid)) {
+            if (!advance(&cursor))
+                return {};
+        }
+    }
+    return ret;
+}
+
+std::optional<QString> EhBackupReader::error() const { return error_; }
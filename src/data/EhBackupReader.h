@@ -0,0 +1,47 @@
+#ifndef EHBACKUPREADER_H
+#define EHBACKUPREADER_H
+
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "DatabaseSchema.h"
+
+// Reads the downloads of several EhViewer backup dbs one row at a time, merged by gid.
+// Every db is read by a forward-only query ordered by gid, so memory use doesn't
+// depend on the size of the backups. A gid found in several backups is returned
+// once, from the last db of the list that has it.
+// Opens its own connections, must be used by a single thread.
+class EhBackupReader {
+  public:
+    explicit EhBackupReader(QStringList db_files);
+    // closes the connections
+    ~EhBackupReader();
+
+    // Open every db and start reading. Return a string if any errors occur.
+    std::optional<QString> open();
+    // The entry with the next gid, {} once every db is read or if an error occurs,
+    // see error(). Corrupt entries are logged and skipped.
+    std::optional<schema::EhBackupImport> next();
+    std::optional<QString> error() const;
+
+  private:
+    struct Cursor {
+        QString connection_name;
+        QString db_file;
+        std::unique_ptr<QSqlQuery> query;
+        // the row the query is on, {} once it's read to the end
+        std::optional<schema::EhBackupImport> current;
+    };
+    // move the cursor to its next valid row, return false if error
+    bool advance(Cursor *cursor);
+
+    QStringList db_files_;
+    std::vector<Cursor> cursors_;
+    std::optional<QString> error_;
+};
+
+#endif // EHBACKUPREADER_H
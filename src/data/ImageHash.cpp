@@ -0,0 +1,25 @@
+#include "ImageHash.h"
+
+#include <QImage>
+#include <QtAlgorithms>
+
+std::optional<uint64_t> ImageHash::DHash(const QByteArray &encoded) {
+    QImage image;
+    if (!image.loadFromData(encoded))
+        return {};
+    // scaled first, smooth scaling works in 32 bit color anyway
+    const QImage small =
+        image.scaled(9, 8, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+            .convertToFormat(QImage::Format_Grayscale8);
+    uint64_t hash = 0;
+    for (int y = 0; y < 8; y++) {
+        const uchar *row = small.constScanLine(y);
+        for (int x = 0; x < 8; x++)
+            hash = (hash << 1) | (row[x] > row[x + 1] ? 1 : 0);
+    }
+    return hash;
+}
+
+int ImageHash::Distance(uint64_t a, uint64_t b) {
+    return qPopulationCount(quint64(a ^ b));
+}
@@ -0,0 +1,20 @@
+#ifndef IMAGEHASH_H
+#define IMAGEHASH_H
+
+#include <QByteArray>
+#include <cstdint>
+#include <optional>
+
+// 64 bit difference hash (dHash) of an image: the image is scaled down to 9x8 gray
+// pixels, a bit per pair of neighbours tells whether the left one is brighter.
+// Rescaling and re-encoding barely change it, visually identical covers are a few
+// bits apart whatever their size or jpeg quality.
+class ImageHash {
+  public:
+    // {} if `encoded` can't be decoded
+    static std::optional<uint64_t> DHash(const QByteArray &encoded);
+    // number of differing bits
+    static int Distance(uint64_t a, uint64_t b);
+};
+
+#endif // IMAGEHASH_H
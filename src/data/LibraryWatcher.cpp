@@ -0,0 +1,213 @@
+#include "LibraryWatcher.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QtConcurrent>
+#include <algorithm>
+
+#include "DataStore.h"
+
+namespace {
+// quiet period before an update, copying a gallery changes its folder once per file
+constexpr int kDebounceMs = 3000;
+
+// same form as the paths recorded by DataImporter::ScanFolder()
+QString NormalizedPath(const QString &path) {
+    return QFileInfo(QDir(path).absolutePath()).absoluteFilePath();
+}
+
+bool IsUnder(const QString &path, const QString &root) {
+    return path == root || (path.size() > root.size() && path.startsWith(root) &&
+                            path[root.size()] == '/');
+}
+
+bool IsUnderAny(const QString &path, const QStringList &roots) {
+    return std::any_of(roots.begin(), roots.end(),
+                       [&path](const QString &root) { return IsUnder(path, root); });
+}
+} // namespace
+
+LibraryWatcher::LibraryWatcher(QObject *parent) : QObject(parent) {
+    // one update at a time
+    pool_.setMaxThreadCount(1);
+    // the thread keeps its connections between updates
+    pool_.setExpiryTimeout(-1);
+    debounce_timer_.setSingleShot(true);
+    debounce_timer_.setInterval(kDebounceMs);
+    connect(&debounce_timer_, &QTimer::timeout, this, &LibraryWatcher::startUpdate);
+    connect(&fs_watcher_, &QFileSystemWatcher::directoryChanged, this,
+            &LibraryWatcher::onDirectoryChanged);
+    connect(&update_watcher_, &QFutureWatcher<UpdateResult>::finished, this,
+            &LibraryWatcher::onUpdateFinished);
+}
+
+LibraryWatcher::~LibraryWatcher() {
+    cancel_update_ = true;
+    pool_.waitForDone();
+    DataStore::ClosePoolConnections(pool_);
+}
+
+QStringList LibraryWatcher::ConfiguredRoots() {
+    return DataStore::GetSettings().value("library/watched_roots").toStringList();
+}
+
+void LibraryWatcher::setRoots(const QStringList &roots) {
+    QStringList new_roots;
+    for (const QString &root : roots) {
+        if (!root.trimmed().isEmpty())
+            new_roots << NormalizedPath(root.trimmed());
+    }
+    new_roots.removeDuplicates();
+
+    QStringList stale;
+    const QStringList watched = fs_watcher_.directories();
+    for (const QString &dir : watched) {
+        if (!IsUnderAny(dir, new_roots))
+            stale << dir;
+    }
+    if (!stale.isEmpty())
+        fs_watcher_.removePaths(stale);
+    for (auto it = changed_dirs_.begin(); it != changed_dirs_.end();) {
+        if (IsUnderAny(*it, new_roots))
+            ++it;
+        else
+            it = changed_dirs_.erase(it);
+    }
+    for (const QString &root : qAsConst(new_roots)) {
+        if (!roots_.contains(root))
+            changed_dirs_ << root;
+    }
+    roots_ = new_roots;
+    qInfo() << "LibraryWatcher: watching" << roots_;
+    startUpdate();
+}
+
+void LibraryWatcher::pause() {
+    paused_ = true;
+    if (!updating_)
+        return;
+    // the update stops after the batch it is writing, its folders are updated again
+    // on resume()
+    cancel_update_ = true;
+    update_watcher_.waitForFinished();
+}
+
+void LibraryWatcher::resume() {
+    paused_ = false;
+    if (!changed_dirs_.isEmpty())
+        debounce_timer_.start();
+}
+
+void LibraryWatcher::onDirectoryChanged(const QString &path) {
+    changed_dirs_ << path;
+    // restarted by every event, the update waits for the burst to end
+    debounce_timer_.start();
+}
+
+void LibraryWatcher::startUpdate() {
+    if (paused_ || updating_ || changed_dirs_.isEmpty())
+        return;
+    // a folder is updated with everything below it
+    QStringList sorted = changed_dirs_.values();
+    std::sort(sorted.begin(), sorted.end());
+    QStringList dirs;
+    for (const QString &dir : qAsConst(sorted)) {
+        if ((dirs.isEmpty() || !IsUnder(dir, dirs.last())) && IsUnderAny(dir, roots_))
+            dirs << dir;
+    }
+    changed_dirs_.clear();
+    if (dirs.isEmpty())
+        return;
+    QStringList roots;
+    for (const QString &root : qAsConst(roots_)) {
+        if (std::any_of(dirs.begin(), dirs.end(),
+                        [&root](const QString &dir) { return IsUnder(dir, root); }))
+            roots << root;
+    }
+
+    updating_ = true;
+    cancel_update_ = false;
+    update_watcher_.setFuture(
+        QtConcurrent::run(&pool_, RunUpdate, dirs, roots, &cancel_update_));
+}
+
+LibraryWatcher::UpdateResult
+LibraryWatcher::RunUpdate(QStringList dirs, QStringList roots,
+                          const std::atomic<bool> *cancelled) {
+    UpdateResult result;
+    result.dirs = dirs;
+    result.roots = roots;
+    // a removed folder is taken care of by the update of its parent
+    QStringList existing;
+    for (const QString &dir : qAsConst(dirs)) {
+        if (QFileInfo(dir).isDir())
+            existing << dir;
+    }
+    qInfo() << "LibraryWatcher: updating" << existing;
+    result.error = DataImporter::UpdateFolders(existing, &result.update, cancelled);
+    result.cancelled = *cancelled;
+
+    {
+        auto db = DataStore::OpenReadConnection();
+        for (const QString &root : qAsConst(roots)) {
+            if (!QFileInfo(root).isDir())
+                continue;
+            result.watch_dirs << root;
+            auto fingerprints =
+                db ? DataStore::DbListDirFingerprints(*db, root) : std::nullopt;
+            if (!fingerprints)
+                continue;
+            QSet<QString> parents;
+            for (const schema::DirFingerprints &fp : qAsConst(*fingerprints))
+                parents << fp.parent;
+            for (const schema::DirFingerprints &fp : qAsConst(*fingerprints)) {
+                if (fp.path != root &&
+                    (parents.contains(fp.path) || fp.cover_fname.isEmpty()))
+                    result.watch_dirs << fp.path;
+            }
+        }
+    }
+    return result;
+}
+
+void LibraryWatcher::onUpdateFinished() {
+    updating_ = false;
+    UpdateResult result = update_watcher_.result();
+    if (result.cancelled) {
+        for (const QString &dir : qAsConst(result.dirs))
+            changed_dirs_ << dir;
+    } else if (result.error) {
+        qWarning() << "LibraryWatcher: update failed" << *result.error;
+        emit updateFailed(*result.error);
+    } else if (result.update.added > 0 || result.update.removed > 0) {
+        emit libraryUpdated(result.update.added, result.update.removed);
+    }
+
+    // replace the watches below the updated roots, unless the root was dropped meanwhile
+    QSet<QString> wanted;
+    for (const QString &dir : qAsConst(result.watch_dirs)) {
+        if (IsUnderAny(dir, roots_))
+            wanted << dir;
+    }
+    QStringList stale;
+    const QStringList watched = fs_watcher_.directories();
+    for (const QString &dir : watched) {
+        if (IsUnderAny(dir, result.roots) && !wanted.contains(dir))
+            stale << dir;
+        wanted.remove(dir);
+    }
+    if (!stale.isEmpty())
+        fs_watcher_.removePaths(stale);
+    if (!wanted.isEmpty()) {
+        QStringList failed = fs_watcher_.addPaths(wanted.values());
+        // most likely out of inotify watches, see fs.inotify.max_user_watches
+        if (!failed.isEmpty())
+            qWarning() << "LibraryWatcher: failed to watch" << failed.size() << "folders";
+    }
+    qInfo() << "LibraryWatcher: watching" << fs_watcher_.directories().size()
+            << "folders";
+
+    if (!changed_dirs_.isEmpty() && !debounce_timer_.isActive())
+        startUpdate();
+}
@@ -0,0 +1,77 @@
+#ifndef LIBRARYWATCHER_H
+#define LIBRARYWATCHER_H
+
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <cinttypes>
+#include <optional>
+
+#include "DataImporter.h"
+
+// Keeps the db in sync with the library folders configured in the settings while the
+// application runs, see DataImporter::UpdateFolders().
+// Only folders that can get new galleries are watched: the roots, folders with
+// subfolders and folders without images yet (e.g. a download in progress). A gallery
+// folder full of images costs no inotify watch, a large library needs a few thousand.
+// Bursts of changes are collected for a few seconds, then updated in one batch on a
+// worker thread. Signals are emitted on the thread owning the watcher.
+class LibraryWatcher : public QObject {
+    Q_OBJECT
+  public:
+    explicit LibraryWatcher(QObject *parent = nullptr);
+    // stops the running update and waits for it
+    ~LibraryWatcher() override;
+
+    // "library/watched_roots" of the settings
+    static QStringList ConfiguredRoots();
+
+    // Watch these roots instead, an empty list stops watching. Every new root is
+    // updated once, which picks up what changed while it wasn't watched.
+    void setRoots(const QStringList &roots);
+    // Hold the updates while something else imports, changes are still collected.
+    // Blocks until the running update has stopped, so the importer doesn't race it for
+    // the same folders.
+    void pause();
+    void resume();
+
+  signals:
+    void libraryUpdated(int64_t added, int64_t removed);
+    void updateFailed(QString message);
+
+  private slots:
+    void onDirectoryChanged(const QString &path);
+    void onUpdateFinished();
+
+  private:
+    struct UpdateResult {
+        std::optional<QString> error;
+        bool cancelled = false;
+        QStringList dirs; // what was asked to be updated
+        DataImporter::FolderUpdate update;
+        QStringList roots; // the roots the watch list is for
+        QStringList watch_dirs;
+    };
+    // run on the worker thread
+    static UpdateResult RunUpdate(QStringList dirs, QStringList roots,
+                                  const std::atomic<bool> *cancelled);
+    void startUpdate();
+
+    QFileSystemWatcher fs_watcher_;
+    QTimer debounce_timer_;
+    QThreadPool pool_;
+    QFutureWatcher<UpdateResult> update_watcher_;
+    QStringList roots_;
+    QSet<QString> changed_dirs_;
+    bool paused_ = false;
+    bool updating_ = false;
+    std::atomic<bool> cancel_update_{false};
+};
+
+#endif // LIBRARYWATCHER_H
@@ -0,0 +1,45 @@
+#ifndef PARALLELFILTER_H
+#define PARALLELFILTER_H
+
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+// Split [0, count) into chunks and call filter_chunk(begin, end, QVector<T> *out) for
+// each of them on the global thread pool. The outputs are concatenated in chunk order,
+// so the result is the same as a single filter_chunk(0, count, out) whatever the
+// scheduling.
+// A chunk should set up whatever isn't thread safe (e.g. QRegularExpression) itself.
+// There are a few chunks per core, so a chunk slower than the others doesn't hold the
+// whole filter back.
+template <typename T, typename ChunkFilter>
+QVector<T> ParallelFilter(size_t count, const ChunkFilter &filter_chunk,
+                          size_t min_chunk_size = 512) {
+    const size_t max_chunks = std::max(1, QThread::idealThreadCount()) * 4;
+    const size_t chunk_count = std::clamp<size_t>(count / min_chunk_size, 1, max_chunks);
+    QVector<T> ret;
+    if (chunk_count == 1) {
+        filter_chunk(size_t(0), count, &ret);
+        return ret;
+    }
+
+    std::vector<QVector<T>> outputs(chunk_count);
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    QtConcurrent::blockingMap(chunks, [&](size_t chunk) {
+        filter_chunk(count * chunk / chunk_count, count * (chunk + 1) / chunk_count,
+                     &outputs[chunk]);
+    });
+    int total = 0;
+    for (const QVector<T> &output : outputs)
+        total += output.size();
+    ret.reserve(total);
+    for (const QVector<T> &output : outputs)
+        ret += output;
+    return ret;
+}
+
+#endif // PARALLELFILTER_H
@@ -0,0 +1,51 @@
+#include "PostingList.h"
+
+#include <algorithm>
+#include <iterator>
+
+QByteArray PostingList::Encode(const std::vector<int64_t> &fids) {
+    QByteArray ret;
+    ret.reserve(int(fids.size()) + 8);
+    uint64_t prev = 0;
+    for (int64_t fid : fids) {
+        uint64_t delta = uint64_t(fid) - prev;
+        prev = uint64_t(fid);
+        while (delta >= 0x80) {
+            ret.append(char((delta & 0x7f) | 0x80));
+            delta >>= 7;
+        }
+        ret.append(char(delta));
+    }
+    return ret;
+}
+
+std::vector<int64_t> PostingList::Decode(const QByteArray &bytes) {
+    std::vector<int64_t> ret;
+    ret.reserve(bytes.size());
+    uint64_t prev = 0;
+    uint64_t delta = 0;
+    int shift = 0;
+    for (char byte : bytes) {
+        // more continuation bytes than any 64 bit delta has: a corrupt blob
+        if (shift >= 64)
+            break;
+        delta |= uint64_t(uint8_t(byte) & 0x7f) << shift;
+        if (uint8_t(byte) & 0x80) {
+            shift += 7;
+            continue;
+        }
+        prev += delta;
+        ret.push_back(int64_t(prev));
+        delta = 0;
+        shift = 0;
+    }
+    return ret;
+}
+
+std::vector<int64_t> PostingList::Merge(const std::vector<int64_t> &a,
+                                        const std::vector<int64_t> &b) {
+    std::vector<int64_t> ret;
+    ret.reserve(a.size() + b.size());
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(ret));
+    return ret;
+}
@@ -0,0 +1,23 @@
+#ifndef POSTINGLIST_H
+#define POSTINGLIST_H
+
+#include <QByteArray>
+#include <cstdint>
+#include <vector>
+
+// A sorted list of distinct fids stored as delta varints: the first fid, then the
+// difference to the previous one, 7 bits per byte with the high bit set on every byte
+// but the last. Fids of a library are dense, most entries take a single byte.
+class PostingList {
+  public:
+    // `fids` must be sorted and distinct
+    static QByteArray Encode(const std::vector<int64_t> &fids);
+    // a truncated trailing entry is dropped, decoding stops at an entry too long for
+    // 64 bits
+    static std::vector<int64_t> Decode(const QByteArray &bytes);
+    // sorted union of two sorted lists
+    static std::vector<int64_t> Merge(const std::vector<int64_t> &a,
+                                      const std::vector<int64_t> &b);
+};
+
+#endif // POSTINGLIST_H
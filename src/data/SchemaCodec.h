@@ -0,0 +1,121 @@
+#ifndef SCHEMACODEC_H
+#define SCHEMACODEC_H
+
+#include <QByteArray>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+
+#include "DatabaseSchema.h"
+#include "EhentaiApi.h"
+
+// Statements and row codecs generated from the Fields() of a schema struct.
+// Columns are selected, read and bound by index in the order of Fields(), so reading a
+// row costs no column name lookup. A member of a type without a conversion below
+// doesn't compile.
+namespace schema {
+
+namespace codec {
+template <typename T> inline constexpr bool kUnsupportedType = false;
+
+template <typename T> T FromVariant(const QVariant &value) {
+    if constexpr (std::is_same_v<T, QString>) {
+        return value.toString();
+    } else if constexpr (std::is_same_v<T, QByteArray>) {
+        return value.toByteArray();
+    } else if constexpr (std::is_same_v<T, double>) {
+        return value.toDouble();
+    } else if constexpr (std::is_same_v<T, EhCategory>) {
+        return EhentaiApi::CategoryFromString(value.toString().toStdString())
+            .value_or(EhCategory::UNKNOWN);
+    } else if constexpr (std::is_integral_v<T>) {
+        return static_cast<T>(value.toLongLong());
+    } else {
+        static_assert(kUnsupportedType<T>, "no column conversion for this member type");
+    }
+}
+
+template <typename T> QVariant ToVariant(const T &value) {
+    if constexpr (std::is_same_v<T, QString> || std::is_same_v<T, QByteArray> ||
+                  std::is_same_v<T, double>) {
+        return value;
+    } else if constexpr (std::is_same_v<T, EhCategory>) {
+        return QString::fromStdString(EhentaiApi::CategoryToString(value));
+    } else if constexpr (std::is_integral_v<T>) {
+        return qlonglong(value);
+    } else {
+        static_assert(kUnsupportedType<T>, "no column conversion for this member type");
+    }
+}
+
+template <typename Row, typename T>
+void ReadField(const QSqlQuery &query, int index, Row *row, const Field<Row, T> &field) {
+    row->*field.member = FromVariant<T>(query.value(index));
+}
+} // namespace codec
+
+template <typename Row>
+inline constexpr size_t kFieldCount = std::tuple_size_v<decltype(Row::Fields())>;
+
+template <typename Row> QStringList ColumnNames() {
+    QStringList ret;
+    std::apply([&ret](const auto &...field) { ((ret << field.name), ...); },
+               Row::Fields());
+    return ret;
+}
+
+// "fid, title, ...", or "if.fid, if.title, ..." with a table alias
+template <typename Row> QString ColumnList(const QString &alias = QString()) {
+    QStringList columns = ColumnNames<Row>();
+    if (!alias.isEmpty()) {
+        for (QString &column : columns)
+            column.prepend(alias + ".");
+    }
+    return columns.join(", ");
+}
+
+// "SELECT <columns> FROM <table>", append the WHERE clause if any
+template <typename Row> const QString &SelectSql() {
+    static const QString sql =
+        QString("SELECT %1 FROM %2").arg(ColumnList<Row>(), Row::TableName());
+    return sql;
+}
+
+// "<verb> INTO <table>(<columns>) VALUES(?, ...)", verb is e.g. "INSERT OR REPLACE"
+template <typename Row> QString InsertSql(const QString &verb = "INSERT") {
+    QStringList placeholders;
+    for (size_t i = 0; i < kFieldCount<Row>; i++)
+        placeholders << "?";
+    return QString("%1 INTO %2(%3) VALUES(%4)")
+        .arg(verb, Row::TableName(), ColumnList<Row>(), placeholders.join(", "));
+}
+
+// Decode the current row of a query selecting ColumnList<Row>() at `first_column`.
+template <typename Row> Row ReadRow(const QSqlQuery &query, int first_column = 0) {
+    Row row{};
+    int index = first_column;
+    std::apply(
+        [&](const auto &...field) {
+            (codec::ReadField(query, index++, &row, field), ...);
+        },
+        Row::Fields());
+    return row;
+}
+
+// Bind every member of `row` to the placeholders of InsertSql<Row>().
+template <typename Row> void BindRow(QSqlQuery *query, const Row &row) {
+    int index = 0;
+    std::apply(
+        [&](const auto &...field) {
+            (query->bindValue(index++, codec::ToVariant(row.*field.member)), ...);
+        },
+        Row::Fields());
+}
+
+} // namespace schema
+
+#endif // SCHEMACODEC_H
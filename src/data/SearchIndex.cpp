@@ -0,0 +1,250 @@
+#include "SearchIndex.h"
+#include "DataStore.h"
+#include "ParallelFilter.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+
+namespace {
+// forall term in terms, exists kw in [begin, end) s.t. term matches kw
+bool MatchesAll(const QString *begin, const QString *end,
+                const std::vector<SearchTerm> &terms) {
+    for (const SearchTerm &term : terms) {
+        bool has_kw_match = false;
+        for (const QString *s = begin; s != end; s++) {
+            if (term.matches(*s)) {
+                has_kw_match = true;
+                break;
+            }
+        }
+        if (!has_kw_match)
+            return false;
+    }
+
+    return true;
+}
+
+// exists kw in [begin, end), exists term in terms s.t. term matches kw
+bool MatchesAny(const QString *begin, const QString *end,
+                const std::vector<SearchTerm> &terms) {
+    for (const QString *s = begin; s != end; s++) {
+        for (const SearchTerm &term : terms) {
+            if (term.matches(*s))
+                return true;
+        }
+    }
+    return false;
+}
+
+// what a folder is matched by, case folded for SearchTerm. The titles are often the same.
+QStringList Keywords(const schema::SearchDocs &doc) {
+    QStringList ret;
+    for (const QString *title : {&doc.title, &doc.eh_title, &doc.eh_title_jpn}) {
+        QString folded = title->toCaseFolded();
+        if (!folded.isEmpty() && !ret.contains(folded))
+            ret << folded;
+    }
+    ret << doc.tags.toCaseFolded().split('\n', Qt::SkipEmptyParts);
+    return ret;
+}
+} // namespace
+
+bool SearchIndex::rebuild(QSqlDatabase &db) {
+    QElapsedTimer timer;
+    timer.start();
+    // Pending changes are left queued, in case they belong to a transaction that is
+    // not yet visible to us. Applying them again later is harmless.
+    auto docs = DataStore::DbListSearchDocs(db);
+    if (!docs)
+        return false;
+
+    QWriteLocker locker(&lock_);
+    rows_.clear();
+    keywords_.clear();
+    garbage_keywords_ = 0;
+    rows_.reserve(docs->size());
+
+    for (const schema::FolderSearchDoc &folder_doc : qAsConst(*docs)) {
+        Row row{folder_doc.folder, uint32_t(keywords_.size()), 0};
+        const QStringList keywords = Keywords(folder_doc.doc);
+        for (const QString &kw : keywords)
+            keywords_.push_back(kw);
+        row.kw_end = keywords_.size();
+        rows_.push_back(std::move(row));
+    }
+    loaded_ = true;
+    qInfo() << "SearchIndex::rebuild() loaded" << rows_.size() << "folders and"
+            << keywords_.size() << "keywords in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool SearchIndex::isLoaded() const {
+    QReadLocker locker(&lock_);
+    return loaded_;
+}
+
+void SearchIndex::markFolderDirty(int64_t fid) {
+    QMutexLocker locker(&pending_mutex_);
+    pending_fids_.insert(fid);
+}
+
+void SearchIndex::markGidDirty(const QString &gid) {
+    if (gid.isEmpty())
+        return;
+    QMutexLocker locker(&pending_mutex_);
+    pending_gids_.insert(gid);
+}
+
+bool SearchIndex::applyPending(QSqlDatabase &db) {
+    QSet<int64_t> fids;
+    QSet<QString> gids;
+    {
+        QMutexLocker locker(&pending_mutex_);
+        fids.swap(pending_fids_);
+        gids.swap(pending_gids_);
+    }
+    if (fids.isEmpty() && gids.isEmpty())
+        return true;
+
+    {
+        QReadLocker locker(&lock_);
+        // everything will be picked up by rebuild()
+        if (!loaded_)
+            return true;
+        // folders linked to a changed gid need their eh keywords reloaded
+        if (!gids.isEmpty()) {
+            for (const Row &row : rows_) {
+                if (gids.contains(row.folder.eh_gid))
+                    fids.insert(row.folder.fid);
+            }
+        }
+    }
+
+    std::vector<int64_t> fid_list(fids.begin(), fids.end());
+    std::sort(fid_list.begin(), fid_list.end());
+    auto docs = DataStore::DbQuerySearchDocs(db, fid_list);
+    if (!docs) {
+        qCritical() << "SearchIndex::applyPending() failed, index dropped";
+        QWriteLocker locker(&lock_);
+        loaded_ = false;
+        return false;
+    }
+
+    QWriteLocker locker(&lock_);
+    QSet<int64_t> found;
+    for (const schema::FolderSearchDoc &folder_doc : qAsConst(*docs)) {
+        upsertRow(folder_doc.folder, Keywords(folder_doc.doc));
+        found.insert(folder_doc.folder.fid);
+    }
+    // not in db anymore, e.g. the transaction was rolled back
+    for (int64_t fid : fid_list) {
+        if (!found.contains(fid))
+            removeRow(fid);
+    }
+    if (garbage_keywords_ > keywords_.size() / 2)
+        compactKeywords();
+    return true;
+}
+
+QVector<schema::FolderPreview>
+SearchIndex::search(const std::vector<SearchTerm> &include_terms,
+                    const std::vector<SearchTerm> &exclude_terms,
+                    const QSet<int64_t> *candidates, const QSet<int64_t> *excluded,
+                    const std::atomic<bool> *cancelled) const {
+    QReadLocker locker(&lock_);
+    // the rows to match, all of them if there are no candidates
+    std::vector<const Row *> candidate_rows;
+    if (candidates) {
+        std::vector<int64_t> fids(candidates->begin(), candidates->end());
+        std::sort(fids.begin(), fids.end());
+        auto it = rows_.begin();
+        for (int64_t fid : fids) {
+            it = std::lower_bound(
+                it, rows_.end(), fid,
+                [](const Row &row, int64_t key) { return row.folder.fid < key; });
+            if (it == rows_.end())
+                break;
+            if (it->folder.fid == fid)
+                candidate_rows.push_back(&*it);
+        }
+    }
+    const size_t count = candidates ? candidate_rows.size() : rows_.size();
+
+    // Chunks run on the global pool while this thread holds the read lock.
+    // Rows are in fid order and so are the chunks, the results too.
+    const QString *kws = keywords_.data();
+    auto match_chunk = [&](size_t chunk_begin, size_t chunk_end,
+                           QVector<schema::FolderPreview> *out) {
+        // every chunk compiles its own, QRegularExpression isn't thread safe
+        const std::vector<SearchTerm> include = SearchTerm::CloneAll(include_terms);
+        const std::vector<SearchTerm> exclude = SearchTerm::CloneAll(exclude_terms);
+        for (size_t i = chunk_begin; i < chunk_end; i++) {
+            // polled every few hundred rows, an atomic load per row is not free either
+            if (cancelled && ((i - chunk_begin) & 0xff) == 0xff && cancelled->load())
+                break;
+            const Row &row = candidates ? *candidate_rows[i] : rows_[i];
+            // folders without any keyword have never been listed
+            if (row.kw_begin == row.kw_end)
+                continue;
+            if (excluded && excluded->contains(row.folder.fid))
+                continue;
+            const QString *begin = kws + row.kw_begin;
+            const QString *end = kws + row.kw_end;
+            if (MatchesAll(begin, end, include) && !MatchesAny(begin, end, exclude)) {
+                *out << schema::FolderPreview{
+                    .fid = row.folder.fid,
+                    .folder_path = row.folder.folder_path,
+                    .title = row.folder.title,
+                    .record_time = row.folder.record_time,
+                    .eh_gid = row.folder.eh_gid,
+                };
+            }
+        }
+    };
+    return ParallelFilter<schema::FolderPreview>(count, match_chunk);
+}
+
+void SearchIndex::upsertRow(const schema::ImageFolders &folder,
+                            const QStringList &keywords) {
+    uint32_t kw_begin = keywords_.size();
+    for (const QString &kw : keywords)
+        keywords_.push_back(kw);
+    uint32_t kw_end = keywords_.size();
+
+    auto it = std::lower_bound(
+        rows_.begin(), rows_.end(), folder.fid,
+        [](const Row &row, int64_t key) { return row.folder.fid < key; });
+    if (it != rows_.end() && it->folder.fid == folder.fid) {
+        garbage_keywords_ += it->kw_end - it->kw_begin;
+        it->folder = folder;
+        it->kw_begin = kw_begin;
+        it->kw_end = kw_end;
+    } else {
+        rows_.insert(it, Row{folder, kw_begin, kw_end});
+    }
+}
+
+void SearchIndex::removeRow(int64_t fid) {
+    auto it = std::lower_bound(
+        rows_.begin(), rows_.end(), fid,
+        [](const Row &row, int64_t key) { return row.folder.fid < key; });
+    if (it != rows_.end() && it->folder.fid == fid) {
+        garbage_keywords_ += it->kw_end - it->kw_begin;
+        rows_.erase(it);
+    }
+}
+
+void SearchIndex::compactKeywords() {
+    std::vector<QString> compacted;
+    compacted.reserve(keywords_.size() - garbage_keywords_);
+    for (Row &row : rows_) {
+        uint32_t kw_begin = compacted.size();
+        for (uint32_t i = row.kw_begin; i < row.kw_end; i++)
+            compacted.push_back(std::move(keywords_[i]));
+        row.kw_begin = kw_begin;
+        row.kw_end = compacted.size();
+    }
+    keywords_.swap(compacted);
+    garbage_keywords_ = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <QtSql>
+#include <atomic>
+#include <cinttypes>
+#include <vector>
+
+#include "DatabaseSchema.h"
+#include "SearchTerm.h"
+
+// In-memory copy of everything DbSearch() needs: one row per folder and the
+// keywords (titles and tags) it can be matched by, case folded. Built once by
+// rebuild(), then kept in sync through the write hooks in DataStore.
+class SearchIndex {
+  public:
+    // (re)load everything from db, return false if error
+    bool rebuild(QSqlDatabase &db);
+    bool isLoaded() const;
+
+    // Write hooks, called by DataStore::DbInsert* and friends.
+    // Changes are only queued, applyPending() reloads them from db.
+    void markFolderDirty(int64_t fid);
+    void markGidDirty(const QString &gid);
+    // Reload queued folders, should be called once the transaction is finished.
+    // Return false if error, the index is then unloaded and rebuilt on next use.
+    bool applyPending(QSqlDatabase &db);
+
+    // A folder is included if it matches all in include_terms and none in
+    // exclude_terms. If `candidates` is not null, only those folders are considered,
+    // folders in `excluded` are always skipped.
+    // Results are ordered by fid. Returns early once *cancelled is set.
+    QVector<schema::FolderPreview>
+    search(const std::vector<SearchTerm> &include_terms,
+           const std::vector<SearchTerm> &exclude_terms,
+           const QSet<int64_t> *candidates = nullptr,
+           const QSet<int64_t> *excluded = nullptr,
+           const std::atomic<bool> *cancelled = nullptr) const;
+
+  private:
+    struct Row {
+        schema::ImageFolders folder;
+        // keywords of this folder are keywords_[kw_begin, kw_end)
+        uint32_t kw_begin;
+        uint32_t kw_end;
+    };
+
+    // must be called with lock_ held for write
+    void upsertRow(const schema::ImageFolders &folder, const QStringList &keywords);
+    void removeRow(int64_t fid);
+    void compactKeywords();
+
+    mutable QReadWriteLock lock_;
+    bool loaded_ = false;
+    std::vector<Row> rows_; // sorted by fid
+    std::vector<QString> keywords_;
+    size_t garbage_keywords_ = 0; // unreferenced entries in keywords_
+
+    QMutex pending_mutex_;
+    QSet<int64_t> pending_fids_;
+    QSet<QString> pending_gids_;
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,140 @@
+#include "SearchService.h"
+
+#include <QDebug>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+#include "DataStore.h"
+
+SearchService::SearchService(QObject *parent) : QObject(parent) {
+    // A cancelled search may still be finishing when the next one starts.
+    pool_.setMaxThreadCount(2);
+    // the threads keep their connections, and the db cache, between searches
+    pool_.setExpiryTimeout(-1);
+}
+
+SearchService::~SearchService() {
+    cancel();
+    pool_.waitForDone();
+    DataStore::ClosePoolConnections(pool_);
+}
+
+int64_t SearchService::search(QString query) {
+    cancel();
+    int64_t search_id = ++last_search_id_;
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    current_cancelled_ = cancelled;
+
+    using Result = std::optional<QVector<schema::FolderPreview>>;
+    auto *watcher = new QFutureWatcher<Result>(this);
+    connect(watcher, &QFutureWatcher<Result>::finished, this,
+            [this, watcher, search_id, query, cancelled] {
+                watcher->deleteLater();
+                if (cancelled->load()) {
+                    emit searchCancelled(search_id, query);
+                    return;
+                }
+                if (current_cancelled_ == cancelled)
+                    current_cancelled_.reset();
+                Result result = watcher->result();
+                if (!result) {
+                    emit searchFailed(search_id, query);
+                    return;
+                }
+                emit searchFinished(search_id, query, *result);
+            });
+    watcher->setFuture(QtConcurrent::run(&pool_, [query, cancelled]() -> Result {
+        return RunQuery(query, cancelled.get());
+    }));
+    return search_id;
+}
+
+void SearchService::refresh(QStringList queries) {
+    struct Refreshed {
+        QStringList queries;
+        QVector<QVector<schema::FolderPreview>> results;
+    };
+    auto *watcher = new QFutureWatcher<Refreshed>(this);
+    connect(watcher, &QFutureWatcher<Refreshed>::finished, this, [this, watcher] {
+        watcher->deleteLater();
+        Refreshed refreshed = watcher->result();
+        emit refreshFinished(refreshed.queries, refreshed.results);
+    });
+    watcher->setFuture(QtConcurrent::run(&pool_, [queries] {
+        Refreshed ret;
+        for (const QString &query : queries) {
+            auto result = RunQuery(query);
+            if (result) {
+                ret.queries << query;
+                ret.results << *result;
+            }
+        }
+        return ret;
+    }));
+}
+
+void SearchService::cancel() {
+    if (current_cancelled_) {
+        current_cancelled_->store(true);
+        current_cancelled_.reset();
+    }
+}
+
+std::optional<QVector<schema::FolderPreview>>
+SearchService::RunQuery(QString query, const std::atomic<bool> *cancelled) {
+    auto db = DataStore::OpenReadConnection();
+    if (!db)
+        return {};
+    // all statements of the query read the same snapshot, whatever the writer does
+    if (!db->transaction()) {
+        qCritical() << db->lastError();
+        return {};
+    }
+    auto ret = Dispatch(*db, query, cancelled);
+    db->rollback();
+    return ret;
+}
+
+std::optional<QVector<schema::FolderPreview>>
+SearchService::Dispatch(QSqlDatabase &db, QString query,
+                        const std::atomic<bool> *cancelled) {
+    if (query.startsWith("all:", Qt::CaseInsensitive)) {
+        // List whole database.
+        return DataStore::DbListAllFolderPreviews(db);
+    } else if (query.startsWith("similar_to:", Qt::CaseInsensitive)) {
+        // Find similar titles.
+        QString base_title = query.mid(QString("similar_to:").size());
+        return DataStore::DbSearchSimilar(db, base_title, cancelled);
+    } else if (query.startsWith("duplicates:", Qt::CaseInsensitive)) {
+        // Clusters of near duplicate titles over the whole library.
+        return DataStore::DbFindDuplicates(db, cancelled);
+    } else if (query.startsWith("similar_cover:", Qt::CaseInsensitive)) {
+        // Find the folders with the same cover as a folder.
+        bool ok = false;
+        int64_t fid =
+            query.mid(QString("similar_cover:").size()).trimmed().toLongLong(&ok);
+        if (!ok) {
+            qWarning() << "similar_cover: expects a folder id" << query;
+            return QVector<schema::FolderPreview>{};
+        }
+        return DataStore::DbSearchSimilarCover(db, fid);
+    } else {
+        // Search by regex inclusion/exclusion.
+        QStringList inc; // requires all include patterns to be matched
+        QStringList exc; // no exclude pattern match allowed
+        // If not include pattern specified, an implicit ".*" is assumed.
+
+        const auto tmp =
+            query.split(" ", Qt::SkipEmptyParts); // You have to write it this way to make
+                                                  // clazy happy. Stupid.
+        for (const QString &s : tmp) {
+            if (s.startsWith("-")) {
+                if (s.size() > 1)
+                    exc << s.mid(1);
+            } else {
+                inc << s;
+            }
+        }
+        return DataStore::DbSearch(db, inc, exc, cancelled);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef SEARCHSERVICE_H
+#define SEARCHSERVICE_H
+
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QtSql>
+#include <QVector>
+#include <atomic>
+#include <cinttypes>
+#include <memory>
+#include <optional>
+
+#include "DatabaseSchema.h"
+
+// Runs search queries on worker threads so the GUI stays responsive.
+// Every worker thread uses its own read-only connection, see
+// DataStore::OpenReadConnection().
+// Only one search is in flight at a time: starting a new one cancels the previous.
+// Signals are emitted on the thread owning the service.
+class SearchService : public QObject {
+    Q_OBJECT
+  public:
+    explicit SearchService(QObject *parent = nullptr);
+    // cancels the running search, waits for it and closes the db connections
+    ~SearchService() override;
+
+    // Start searching `query`, any search still running is cancelled.
+    // Returns the id reported by the signals below.
+    int64_t search(QString query);
+    void cancel();
+    // Run `queries` again, e.g. after the library changed. Doesn't cancel the running
+    // search, the results come in one refreshFinished() signal.
+    void refresh(QStringList queries);
+
+    // Parse and run `query` on the calling thread, return {} if error.
+    // Query syntax: "all:", "similar_to:<title>", "similar_cover:<fid>", "duplicates:",
+    // or space separated regexes where the ones prefixed with '-' exclude results.
+    static std::optional<QVector<schema::FolderPreview>>
+    RunQuery(QString query, const std::atomic<bool> *cancelled = nullptr);
+
+  signals:
+    void searchFinished(int64_t search_id, QString query,
+                        QVector<schema::FolderPreview> results);
+    void searchFailed(int64_t search_id, QString query);
+    void searchCancelled(int64_t search_id, QString query);
+    // queries that failed are left out
+    void refreshFinished(QStringList queries,
+                         QVector<QVector<schema::FolderPreview>> results);
+
+  private:
+    static std::optional<QVector<schema::FolderPreview>>
+    Dispatch(QSqlDatabase &db, QString query, const std::atomic<bool> *cancelled);
+
+    QThreadPool pool_;
+    int64_t last_search_id_ = 0;
+    std::shared_ptr<std::atomic<bool>> current_cancelled_;
+};
+
+#endif // SEARCHSERVICE_H
@@ -0,0 +1,58 @@
+#include "SearchTerm.h"
+
+#include <QDebug>
+
+std::optional<SearchTerm> SearchTerm::Compile(const QString &term) {
+    SearchTerm ret;
+    if (IsLiteral(term)) {
+        ret.literal_ = true;
+        ret.literal_matcher_.setPattern(term.toCaseFolded());
+        return ret;
+    }
+    ret.regex_.setPattern(term);
+    ret.regex_.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+    if (!ret.regex_.isValid()) {
+        qCritical() << "Invalid search regex:" << term << ret.regex_.errorString();
+        return {};
+    }
+    ret.regex_.optimize();
+    return ret;
+}
+
+bool SearchTerm::IsLiteral(const QString &term) {
+    static const QString kRegexChars = "\\^$.|?*+()[]{}";
+    for (QChar ch : term) {
+        if (kRegexChars.contains(ch))
+            return false;
+    }
+    return true;
+}
+
+SearchTerm SearchTerm::clone() const {
+    SearchTerm ret = *this;
+    if (!literal_) {
+        ret.regex_ = QRegularExpression(regex_.pattern(), regex_.patternOptions());
+        ret.regex_.optimize();
+    }
+    return ret;
+}
+
+std::vector<SearchTerm> SearchTerm::CloneAll(const std::vector<SearchTerm> &terms) {
+    std::vector<SearchTerm> ret;
+    ret.reserve(terms.size());
+    for (const SearchTerm &term : terms)
+        ret.push_back(term.clone());
+    return ret;
+}
+
+bool SearchTerm::isLiteral() const { return literal_; }
+
+bool SearchTerm::matches(const QString &folded_keyword) const {
+    if (literal_)
+        return literal_matcher_.indexIn(folded_keyword) >= 0;
+    // keywords come from the db, they are valid utf-16
+    return regex_
+        .match(folded_keyword, 0, QRegularExpression::NormalMatch,
+               QRegularExpression::DontCheckSubjectStringMatchOption)
+        .hasMatch();
+}
@@ -0,0 +1,40 @@
+#ifndef SEARCHTERM_H
+#define SEARCHTERM_H
+
+#include <QRegularExpression>
+#include <QString>
+#include <QStringMatcher>
+#include <optional>
+#include <vector>
+
+// A search term compiled once per search, then matched against every keyword.
+// Keywords must be case folded (QString::toCaseFolded()), matching is case insensitive.
+// Terms without regex syntax are plain substrings, found by a precomputed
+// QStringMatcher. The others go through a QRegularExpression, JIT compiled by
+// optimize().
+class SearchTerm {
+  public:
+    // {} if `term` is not a valid regex
+    static std::optional<SearchTerm> Compile(const QString &term);
+    // true if `term` has no regex special character, i.e. it matches itself only
+    static bool IsLiteral(const QString &term);
+
+    // A copy that shares nothing that isn't thread safe with this term, for matching
+    // on another thread. QRegularExpression is only reentrant, a copy would share the
+    // compiled pattern.
+    SearchTerm clone() const;
+    static std::vector<SearchTerm> CloneAll(const std::vector<SearchTerm> &terms);
+
+    bool isLiteral() const;
+    // true if the term is found in `folded_keyword`
+    bool matches(const QString &folded_keyword) const;
+
+  private:
+    SearchTerm() = default;
+
+    bool literal_ = false;
+    QStringMatcher literal_matcher_;
+    QRegularExpression regex_;
+};
+
+#endif // SEARCHTERM_H
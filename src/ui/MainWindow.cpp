@@ -24,6 +24,7 @@
 #include "FuzzSearcher.h"
 #include "SettingsDialog.h"
 #include "data/EhentaiApi.h"
+#include "data/SearchIndex.h"
 #include "widget/TabbedSearchResult.h"
 
 namespace {
@@ -63,12 +64,47 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     ui->splitter_result_column->setSizes({5000, 1, 2000});
 
     network_manager_ = new QNetworkAccessManager(this);
+    search_service_ = new SearchService(this);
+    library_watcher_ = new LibraryWatcher(this);
 
     // create database tables
     auto db = DataStore::OpenDatabase().value();
-    if (!DataStore::DbCreateTables(db))
+    std::unique_ptr<QProgressDialog> migration_progress;
+    auto on_migration = [&migration_progress](const QString &table_name,
+                                              int64_t from_revision,
+                                              int64_t to_revision) {
+        if (!migration_progress) {
+            migration_progress = std::make_unique<QProgressDialog>("", QString(), 0, 0);
+            migration_progress->setMinimumDuration(0);
+            migration_progress->setMinimumWidth(500);
+            migration_progress->setWindowTitle("EhDbViewer");
+        }
+        migration_progress->setLabelText(QString("Upgrading table %1 to revision %2...")
+                                             .arg(table_name)
+                                             .arg(to_revision));
+        migration_progress->setValue(0);
+        qInfo() << "Upgrading table" << table_name << "from revision" << from_revision;
+        QApplication::processEvents();
+    };
+    bool db_ready = DataStore::DbCreateTables(db, on_migration);
+    migration_progress.reset();
+    if (!db_ready)
         QMessageBox::warning(this, "EhDbViewer Error", "Failed to initialize database.");
-
+    else if (!DataStore::GetSearchIndex().rebuild(db))
+        QMessageBox::warning(this, "EhDbViewer Error", "Failed to load search index.");
+
+    connect(search_service_, &SearchService::searchFinished, this,
+            &MainWindow::onSearchFinished);
+    connect(search_service_, &SearchService::searchFailed, this,
+            &MainWindow::onSearchFailed);
+    connect(search_service_, &SearchService::searchCancelled, this,
+            &MainWindow::onSearchCancelled);
+    connect(search_service_, &SearchService::refreshFinished, ui->tabSearchResult,
+            &TabbedSearchResult::refreshResults);
+    connect(library_watcher_, &LibraryWatcher::libraryUpdated, this,
+            &MainWindow::onLibraryUpdated);
+    connect(library_watcher_, &LibraryWatcher::updateFailed, this,
+            &MainWindow::onLibraryUpdateFailed);
     connect(ui->txtSearchBar, &QLineEdit::returnPressed, this,
             &MainWindow::onSearchBarEnterPressed);
     connect(ui->tabSearchResult, &TabbedSearchResult::tabChanged, this,
@@ -85,6 +121,9 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
                 if (!query.isEmpty())
                     newSearch(query);
             });
+
+    if (db_ready)
+        library_watcher_->setRoots(LibraryWatcher::ConfiguredRoots());
 }
 
 MainWindow::~MainWindow() { delete ui; }
@@ -96,44 +135,45 @@ void MainWindow::newSearch(QString query) {
         return;
     }
 
-    auto db = DataStore::OpenDatabase().value();
-    std::optional<QList<schema::FolderPreview>> data = {};
-    if (query.startsWith("all:", Qt::CaseInsensitive)) {
-        // List whole database.
-        data = DataStore::DbListAllFolderPreviews(db);
-    } else if (query.startsWith("similar_to:", Qt::CaseInsensitive)) {
-        // Find similar titles.
-        QString base_title = query.mid(QString("similar_to:").size());
-        data = DataStore::DbSearchSimilar(db, base_title);
-    } else {
-        // Search by regex inclusion/exclusion.
-        QStringList inc; // requires all include patterns to be matched
-        QStringList exc; // no exclude pattern match allowed
-        // If not include pattern specified, an implicit ".*" is assumed.
-
-        const auto tmp =
-            query.split(" ", Qt::SkipEmptyParts); // You have to write it this way to make
-                                                  // clazy happy. Stupid.
-        for (const QString &s : tmp) {
-            if (s.startsWith("-")) {
-                if (s.size() > 1)
-                    exc << s.mid(1);
-            } else {
-                inc << s;
-            }
-        }
-        data = DataStore::DbSearch(db, inc, exc);
-    }
+    // the query runs in background, the tab is filled in by onSearchFinished()
+    int64_t search_id = search_service_->search(query);
+    ui->tabSearchResult->displayPendingSearch(search_id, query, true);
+    ui->statusbar->showMessage("Searching " + query);
+}
 
-    if (!data) {
-        QMessageBox::warning(this, "EhDbViewer", "Failed to read database");
-        return;
-    }
-    if (data->isEmpty()) {
+void MainWindow::onSearchFinished(int64_t search_id, QString,
+                                  QVector<schema::FolderPreview> results) {
+    ui->statusbar->clearMessage();
+    if (results.isEmpty()) {
+        ui->tabSearchResult->dropPendingSearch(search_id);
         QMessageBox::information(this, "EhDbViewer", "No search result");
         return;
     }
-    ui->tabSearchResult->displaySearchResult(query, *data, true);
+    ui->tabSearchResult->finishPendingSearch(search_id, results);
+}
+
+void MainWindow::onSearchFailed(int64_t search_id, QString) {
+    ui->statusbar->clearMessage();
+    ui->tabSearchResult->dropPendingSearch(search_id);
+    QMessageBox::warning(this, "EhDbViewer", "Failed to read database");
+}
+
+void MainWindow::onSearchCancelled(int64_t search_id, QString) {
+    ui->tabSearchResult->dropPendingSearch(search_id);
+}
+
+void MainWindow::onLibraryUpdated(int64_t added, int64_t removed) {
+    ui->statusbar->showMessage(
+        QString("Library updated: %1 folders added, %2 removed").arg(added).arg(removed),
+        5000);
+    // the index is already up to date, the open tabs only need their queries again
+    QStringList queries = ui->tabSearchResult->getResultQueryStrings();
+    if (!queries.isEmpty())
+        search_service_->refresh(queries);
+}
+
+void MainWindow::onLibraryUpdateFailed(QString message) {
+    ui->statusbar->showMessage("Failed to update library: " + message, 5000);
 }
 
 // user initiated search
@@ -157,8 +197,14 @@ void MainWindow::onSearchResultSelectionChanged(
     auto displayImageLabel = [this](const schema::FolderPreview *item) {
         bool use_thumbnail = ui->cbUseThumbnail->checkState() == Qt::CheckState::Checked;
         if (use_thumbnail) {
+            auto db = DataStore::OpenDatabase().value();
+            auto covers = DataStore::DbQueryCovers(db, {item->fid});
+            if (!covers) {
+                // TODO error message
+                return;
+            }
             QPixmap pixmap;
-            pixmap.loadFromData(QByteArray::fromBase64(item->cover_base64.toUtf8()));
+            pixmap.loadFromData(covers->value(item->fid));
             if (pixmap.isNull()) {
                 // TODO error,
                 return;
@@ -263,8 +309,14 @@ void MainWindow::onSearchResultSelectionChanged(
 
 void MainWindow::onHoveredItemChanged(std::optional<schema::FolderPreview> item) {
     if (item) {
+        auto db = DataStore::OpenDatabase().value();
+        auto covers = DataStore::DbQueryCovers(db, {item->fid});
+        if (!covers) {
+            // TODO error,
+            return;
+        }
         QPixmap pixmap;
-        pixmap.loadFromData(QByteArray::fromBase64(item->cover_base64.toUtf8()));
+        pixmap.loadFromData(covers->value(item->fid));
         if (pixmap.isNull()) {
             // TODO error,
             return;
@@ -278,13 +330,30 @@ void MainWindow::onHoveredItemChanged(std::optional<schema::FolderPreview> item)
 void MainWindow::on_actionImportFolder_triggered() {
     auto dir = selectDirectory(this, "Select the folder to import");
     if (dir) {
+        // both would insert the new folders
+        library_watcher_->pause();
         auto msg = DataImporter::ImportDir(*dir, this);
+        library_watcher_->resume();
         QMessageBox::information(this, "Import directory", msg);
     } else {
         ui->statusbar->showMessage("Folder selection cancelled.", 5000);
     }
 }
 
+// also lists the folders whose fingerprint didn't change, e.g. after the
+// library was restored from a backup with the original mtimes
+void MainWindow::on_actionRescanFolderFully_triggered() {
+    auto dir = selectDirectory(this, "Select the folder to rescan");
+    if (dir) {
+        library_watcher_->pause();
+        auto msg = DataImporter::ImportDir(*dir, this, true);
+        library_watcher_->resume();
+        QMessageBox::information(this, "Rescan directory", msg);
+    } else {
+        ui->statusbar->showMessage("Folder selection cancelled.", 5000);
+    }
+}
+
 void MainWindow::on_actionImportEhViewerBackup_triggered() {
     auto settings = DataStore::GetSettings();
     QString db_file_folder = settings.value("history/eh_db_import_folder", "").toString();
@@ -305,15 +374,20 @@ void MainWindow::on_actionImportEhViewerBackup_triggered() {
     }
     qDebug() << db_filepaths;
     qDebug() << download_dir;
+    library_watcher_->pause();
     auto msg = DataImporter::ImportEhViewerBackup(db_filepaths, download_dir, this);
+    library_watcher_->resume();
     QMessageBox::information(this, "Import EhViewer backup", msg);
 }
 
+void MainWindow::on_actionFindDuplicates_triggered() { newSearch("duplicates:"); }
+
 void MainWindow::on_actionSettings_triggered() {
     SettingsDialog settings_dialog{};
     int code = settings_dialog.exec();
     if (code == QDialog::DialogCode::Accepted) {
         qDebug() << "config saved";
+        library_watcher_->setRoots(LibraryWatcher::ConfiguredRoots());
     } else {
         qDebug() << "config not saved";
     }
@@ -3,6 +3,8 @@
 
 #include "data/DataImporter.h"
 #include "data/DataStore.h"
+#include "data/LibraryWatcher.h"
+#include "data/SearchService.h"
 #include "widget/AspectRatioLabel.h"
 
 #include <QMainWindow>
@@ -30,10 +32,18 @@ class MainWindow : public QMainWindow {
     void onSearchResultTabChanged(QString new_tab_query);
     void onSearchResultSelectionChanged(QList<schema::FolderPreview> new_selections);
     void onHoveredItemChanged(std::optional<schema::FolderPreview> item);
+    void onSearchFinished(int64_t search_id, QString query,
+                          QVector<schema::FolderPreview> results);
+    void onSearchFailed(int64_t search_id, QString query);
+    void onSearchCancelled(int64_t search_id, QString query);
+    void onLibraryUpdated(int64_t added, int64_t removed);
+    void onLibraryUpdateFailed(QString message);
 
   private slots:
     void on_actionImportFolder_triggered();
+    void on_actionRescanFolderFully_triggered();
     void on_actionImportEhViewerBackup_triggered();
+    void on_actionFindDuplicates_triggered();
     void on_actionSettings_triggered();
 
   private slots:
@@ -43,5 +53,7 @@ class MainWindow : public QMainWindow {
   private:
     Ui::MainWindow *ui;
     QNetworkAccessManager *network_manager_;
+    SearchService *search_service_;
+    LibraryWatcher *library_watcher_;
 };
 #endif // MAINWINDOW_H
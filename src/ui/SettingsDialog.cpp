@@ -10,6 +10,8 @@ SettingsDialog::SettingsDialog(QWidget *parent)
     QString phash = settings.value("ehentai/ipb_pass_hash", "").toString();
     ui->eh_member_id->setText(mid);
     ui->eh_pass_hash->setText(phash);
+    QStringList roots = settings.value("library/watched_roots").toStringList();
+    ui->watched_roots->setPlainText(roots.join('\n'));
 }
 
 SettingsDialog::~SettingsDialog() { delete ui; }
@@ -18,6 +20,8 @@ void SettingsDialog::on_button_box_accepted() {
     auto settings = DataStore::GetSettings();
     settings.setValue("ehentai/ipb_member_id", ui->eh_member_id->text());
     settings.setValue("ehentai/ipb_pass_hash", ui->eh_pass_hash->text());
+    QStringList roots = ui->watched_roots->toPlainText().split('\n', Qt::SkipEmptyParts);
+    settings.setValue("library/watched_roots", roots);
     accept();
 }
 
@@ -0,0 +1,58 @@
+#include "SearchResultModel.h"
+
+#include "data/DataStore.h"
+
+SearchResultModel::SearchResultModel(QVector<schema::FolderPreview> results,
+                                     QObject *parent)
+    : QAbstractTableModel(parent), results_(std::move(results)) {}
+
+SearchResultModel *SearchResultModel::Pending(QObject *parent) {
+    auto *model = new SearchResultModel({}, parent);
+    model->pending_ = true;
+    return model;
+}
+
+int SearchResultModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : results_.size();
+}
+
+int SearchResultModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : 1;
+}
+
+QVariant SearchResultModel::data(const QModelIndex &index, int role) const {
+    const schema::FolderPreview *item = preview(index.row());
+    if (item == nullptr || index.column() != 0)
+        return {};
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return item->title;
+    case Qt::ToolTipRole: {
+        // the cover is only loaded when the tooltip is actually shown
+        auto db = DataStore::OpenDatabase();
+        if (!db)
+            return {};
+        auto covers = DataStore::DbQueryCovers(*db, {item->fid});
+        if (!covers || !covers->contains(item->fid))
+            return {};
+        return QString("<img src=\"data:image/jpeg;base64,%0\">")
+            .arg(QString::fromLatin1(covers->value(item->fid).toBase64()));
+    }
+    default:
+        return {};
+    }
+}
+
+QVariant SearchResultModel::headerData(int section, Qt::Orientation orientation,
+                                       int role) const {
+    if (role == Qt::DisplayRole && orientation == Qt::Horizontal && section == 0)
+        return pending_ ? "Searching..." : "Title";
+    return {};
+}
+
+const schema::FolderPreview *SearchResultModel::preview(int row) const {
+    if (row < 0 || row >= results_.size())
+        return nullptr;
+    return &results_.at(row);
+}
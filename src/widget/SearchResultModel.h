@@ -0,0 +1,32 @@
+#ifndef SEARCHRESULTMODEL_H
+#define SEARCHRESULTMODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+
+#include "data/DatabaseSchema.h"
+
+// Read-only model over a search result. The vector is implicitly shared with whoever
+// produced it and never modified, display data is only made for rows the view asks.
+class SearchResultModel : public QAbstractTableModel {
+    Q_OBJECT
+  public:
+    SearchResultModel(QVector<schema::FolderPreview> results, QObject *parent);
+    // placeholder shown while a search is still running
+    static SearchResultModel *Pending(QObject *parent);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+
+    // nullptr if row is out of range
+    const schema::FolderPreview *preview(int row) const;
+
+  private:
+    const QVector<schema::FolderPreview> results_;
+    bool pending_ = false;
+};
+
+#endif // SEARCHRESULTMODEL_H
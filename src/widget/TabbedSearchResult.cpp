@@ -6,27 +6,9 @@
 #include <QMessageBox>
 #include <QModelIndex>
 #include <QMouseEvent>
-#include <QStandardItemModel>
 #include <QTableView>
 
-namespace {
-// Wrap FolderPreview into an ListView item.
-class SearchResultItem : public QStandardItem {
-  public:
-    explicit SearchResultItem(schema::FolderPreview data)
-        : QStandardItem(), schema_(data) {
-        setText(schema_.title);
-        QString html =
-            QString("<img src=\"data:image/jpeg;base64,%0\">").arg(schema_.cover_base64);
-        setToolTip(html);
-    }
-
-    const schema::FolderPreview &schema() const { return schema_; }
-
-  private:
-    schema::FolderPreview schema_;
-};
-} // namespace
+#include "SearchResultModel.h"
 
 void MouseHoverAwareTableView::mouseMoveEvent(QMouseEvent *ev) {
     QModelIndex idx = this->indexAt(ev->pos());
@@ -67,7 +49,7 @@ QList<schema::FolderPreview> TabbedSearchResult::getSelection() {
         return {};
     }
 
-    auto *model = qobject_cast<QStandardItemModel *>(table->model());
+    auto *model = qobject_cast<SearchResultModel *>(table->model());
     if (model == nullptr) {
         qCritical() << "Invalid table model in TabbedSearchResult::getSelection:"
                     << table->model();
@@ -85,48 +67,100 @@ QList<schema::FolderPreview> TabbedSearchResult::getSelection() {
     const auto selected_rows = sel->selectedRows();
     for (const auto &model_index : selected_rows) {
         int row = model_index.row();
-        auto *item = dynamic_cast<SearchResultItem *>(model->item(row));
+        const auto *item = model->preview(row);
         if (item == nullptr) {
-            qCritical() << "Invalid item in TabbedSearchResult::getSelection:"
-                        << model->item(row);
+            qCritical() << "Invalid row in TabbedSearchResult::getSelection:" << row;
             QMessageBox::warning(this, "Bug Alert",
                                  "A bug is detected, please report the console error log "
                                  "to the developer.");
             return {};
         }
-        ret << item->schema();
+        ret << *item;
     }
     return ret;
 }
 
+namespace {
+// set on the table of a pending search, holds the search id
+const char *kSearchIdProperty = "search_id";
+} // namespace
+
+QStringList TabbedSearchResult::getResultQueryStrings() {
+    QStringList ret;
+    for (int i = 0; i < this->count(); i++) {
+        if (!this->widget(i)->property(kSearchIdProperty).isValid())
+            ret << this->tabText(i);
+    }
+    ret.removeDuplicates();
+    return ret;
+}
+
 void TabbedSearchResult::displaySearchResult(QString query_string,
-                                             QList<schema::FolderPreview> results,
+                                             QVector<schema::FolderPreview> results,
                                              bool in_new_tab) {
-    auto set_table_model = [&](QTableView *table) {
-        QStandardItemModel *model = new QStandardItemModel(table);
-        model->setHorizontalHeaderLabels({"Title"});
-        for (const schema::FolderPreview &data : results) {
-            model->appendRow(new SearchResultItem(data));
-        }
-        table->setModel(model);
-    };
+    showModel(query_string, new SearchResultModel(results, nullptr), in_new_tab);
+}
+
+void TabbedSearchResult::displayPendingSearch(int64_t search_id, QString query_string,
+                                              bool in_new_tab) {
+    QTableView *table =
+        showModel(query_string, SearchResultModel::Pending(nullptr), in_new_tab);
+    if (table != nullptr)
+        table->setProperty(kSearchIdProperty, qlonglong(search_id));
+}
 
+void TabbedSearchResult::finishPendingSearch(int64_t search_id,
+                                             QVector<schema::FolderPreview> results) {
+    int idx = findPendingTab(search_id);
+    if (idx < 0)
+        return;
+    auto *table = qobject_cast<QTableView *>(this->widget(idx));
+    table->setProperty(kSearchIdProperty, QVariant());
+    setTableModel(table, new SearchResultModel(results, nullptr));
+}
+
+void TabbedSearchResult::dropPendingSearch(int64_t search_id) {
+    int idx = findPendingTab(search_id);
+    if (idx < 0)
+        return;
+    QWidget *table = this->widget(idx);
+    this->removeTab(idx);
+    table->deleteLater();
+}
+
+void TabbedSearchResult::refreshResults(QStringList query_strings,
+                                        QVector<QVector<schema::FolderPreview>> results) {
+    for (int i = 0; i < this->count(); i++) {
+        auto *table = qobject_cast<QTableView *>(this->widget(i));
+        // pending tabs get their results from the search that is still running
+        if (table == nullptr || table->property(kSearchIdProperty).isValid())
+            continue;
+        int idx = query_strings.indexOf(this->tabText(i));
+        if (idx >= 0 && idx < results.size())
+            setTableModel(table, new SearchResultModel(results[idx], nullptr));
+    }
+    // the selection is gone with the old models
+    emit selectionChanged(getSelection());
+}
+
+QTableView *TabbedSearchResult::showModel(QString query_string, SearchResultModel *model,
+                                          bool in_new_tab) {
     if (this->count() == 0 || in_new_tab) {
         int insert_index = this->currentIndex() + 1;
         MouseHoverAwareTableView *table = new MouseHoverAwareTableView(this);
-        set_table_model(table);
+        setTableModel(table, model);
 
         connect(table, &QTableView::doubleClicked, this,
                 &TabbedSearchResult::onTableDoubleClicked);
         connect(table, &QTableView::customContextMenuRequested, this,
                 &TabbedSearchResult::onTableContextMenuRequested);
-        connect(table->selectionModel(), &QItemSelectionModel::selectionChanged, this,
-                &TabbedSearchResult::onTableSelectionChanged);
         connect(table, &MouseHoverAwareTableView::hoveredIndexChanged, this,
                 &TabbedSearchResult::onTableHoveredRowChanged);
 
         table->setContextMenuPolicy(Qt::CustomContextMenu);
         table->verticalHeader()->setVisible(false);
+        // uniform rows, so the view never measures rows it doesn't show
+        table->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
         table->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
         table->setEditTriggers(QAbstractItemView::EditTrigger::NoEditTriggers);
 
@@ -135,6 +169,7 @@ void TabbedSearchResult::displaySearchResult(QString query_string,
         this->setTabToolTip(idx, query_string);
         this->setCurrentIndex(idx);
         this->setUpdatesEnabled(true);
+        return table;
     } else {
         int idx = this->currentIndex();
         QTableView *table = qobject_cast<QTableView *>(this->currentWidget());
@@ -144,15 +179,12 @@ void TabbedSearchResult::displaySearchResult(QString query_string,
             QMessageBox::warning(this, "Bug Alert",
                                  "A bug is detected, please report the console error log "
                                  "to the developer.");
-            return;
+            delete model;
+            return nullptr;
         }
-        auto old_model = table->model();
-        table->setModel(nullptr);
-        old_model->deleteLater();
-        set_table_model(table);
-
-        connect(table->selectionModel(), &QItemSelectionModel::selectionChanged, this,
-                &TabbedSearchResult::onTableSelectionChanged);
+        // the tab no longer belongs to the search that was pending in it
+        table->setProperty(kSearchIdProperty, QVariant());
+        setTableModel(table, model);
 
         table->verticalHeader()->setVisible(false);
         table->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
@@ -161,7 +193,27 @@ void TabbedSearchResult::displaySearchResult(QString query_string,
         this->setTabText(idx, query_string);
         this->setTabToolTip(idx, query_string);
         this->setCurrentIndex(idx);
+        return table;
+    }
+}
+
+void TabbedSearchResult::setTableModel(QTableView *table, SearchResultModel *model) {
+    auto *old_model = table->model();
+    model->setParent(table);
+    table->setModel(model);
+    if (old_model != nullptr)
+        old_model->deleteLater();
+    connect(table->selectionModel(), &QItemSelectionModel::selectionChanged, this,
+            &TabbedSearchResult::onTableSelectionChanged);
+}
+
+int TabbedSearchResult::findPendingTab(int64_t search_id) {
+    for (int i = 0; i < this->count(); i++) {
+        QVariant id = this->widget(i)->property(kSearchIdProperty);
+        if (id.isValid() && id.toLongLong() == search_id)
+            return i;
     }
+    return -1;
 }
 
 void TabbedSearchResult::onTableSelectionChanged(const QItemSelection &,
@@ -177,8 +229,10 @@ void TabbedSearchResult::onTableContextMenuRequested(const QPoint &pos) {
         QMenu *menu = new QMenu(this);
         auto *open_dir_action = new QAction("Open in File Explorer", this);
         auto *search_similar_action = new QAction("Search similar title", this);
+        auto *search_cover_action = new QAction("Search same cover", this);
         menu->addAction(open_dir_action);
         menu->addAction(search_similar_action);
+        menu->addAction(search_cover_action);
 
         if (selected_items.size() > 0) {
             if (selected_items.size() > 100) {
@@ -208,8 +262,13 @@ void TabbedSearchResult::onTableContextMenuRequested(const QPoint &pos) {
             const QString &title = selected_items[0].title;
             connect(search_similar_action, &QAction::triggered,
                     [this, title] { emit this->queryRequested("similar_to:" + title); });
+            const int64_t fid = selected_items[0].fid;
+            connect(search_cover_action, &QAction::triggered, [this, fid] {
+                emit this->queryRequested("similar_cover:" + QString::number(fid));
+            });
         } else {
             search_similar_action->setEnabled(false);
+            search_cover_action->setEnabled(false);
         }
         return menu;
     };
@@ -252,17 +311,17 @@ void TabbedSearchResult::onTableHoveredRowChanged(QModelIndex index) {
         emit hoverChanged({});
         return;
     }
-    const auto *model = qobject_cast<const QStandardItemModel *>(index.model());
+    const auto *model = qobject_cast<const SearchResultModel *>(index.model());
     if (model == nullptr) {
         emit hoverChanged({});
         return;
     }
-    auto *item = dynamic_cast<SearchResultItem *>(model->item(index.row()));
+    const auto *item = model->preview(index.row());
     if (item == nullptr) {
         emit hoverChanged({});
         return;
     }
-    emit hoverChanged(item->schema());
+    emit hoverChanged(*item);
 }
 
 void TabbedSearchResult::onTabChanged(int) {
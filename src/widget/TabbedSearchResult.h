@@ -9,6 +9,8 @@
 
 #include "data/DatabaseSchema.h"
 
+class SearchResultModel;
+
 class MouseHoverAwareTableView : public QTableView {
     Q_OBJECT
   public:
@@ -32,10 +34,20 @@ class TabbedSearchResult : public QTabWidget {
     QString getSelectedTabQueryString();
     // maybe empty
     QList<schema::FolderPreview> getSelection();
+    // query strings of the tabs showing a finished search
+    QStringList getResultQueryStrings();
 
   public slots:
-    void displaySearchResult(QString query_string, QList<schema::FolderPreview> results,
+    void displaySearchResult(QString query_string, QVector<schema::FolderPreview> results,
                              bool in_new_tab);
+    // Show an empty tab for a search that is still running, see SearchService.
+    void displayPendingSearch(int64_t search_id, QString query_string, bool in_new_tab);
+    // Fill in or close the tab of a pending search, no-op if the tab is already closed.
+    void finishPendingSearch(int64_t search_id, QVector<schema::FolderPreview> results);
+    void dropPendingSearch(int64_t search_id);
+    // Replace the results of the finished tabs showing one of `query_strings`.
+    void refreshResults(QStringList query_strings,
+                        QVector<QVector<schema::FolderPreview>> results);
 
   signals:
     void selectionChanged(QList<schema::FolderPreview> selected);
@@ -50,6 +62,14 @@ class TabbedSearchResult : public QTabWidget {
     void onTableHoveredRowChanged(QModelIndex idx);
     void onTabChanged(int index);
     void onTabCloseRequested(int index);
+
+  private:
+    // returns nullptr if error
+    QTableView *showModel(QString query_string, SearchResultModel *model,
+                          bool in_new_tab);
+    void setTableModel(QTableView *table, SearchResultModel *model);
+    // tab index, -1 if not found
+    int findPendingTab(int64_t search_id);
 };
 
 #endif // TABBEDSEARCHRESULT_H
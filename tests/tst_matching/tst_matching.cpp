@@ -0,0 +1,88 @@
+#include <QtTest>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "FuzzSearcher.h"
+#include "data/PostingList.h"
+
+Q_DECLARE_METATYPE(std::vector<int64_t>)
+
+// SubstringAutomaton against the dynamic programming it replaced, and the posting lists
+// of the title trigrams it is matched with.
+class TestMatching : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void longestCommonSubstring_data();
+    void longestCommonSubstring();
+    void postingListRoundTrip_data();
+    void postingListRoundTrip();
+    void postingListCorruptBlob();
+};
+
+void TestMatching::longestCommonSubstring_data() {
+    QTest::addColumn<QString>("a");
+    QTest::addColumn<QString>("b");
+    QTest::addColumn<int>("expected");
+
+    QTest::newRow("both empty") << QString() << QString() << 0;
+    QTest::newRow("empty stem") << QString() << QString("abc") << 0;
+    QTest::newRow("empty candidate") << QString("abc") << QString() << 0;
+    QTest::newRow("same char") << QString("a") << QString("a") << 1;
+    QTest::newRow("other char") << QString("a") << QString("b") << 0;
+    QTest::newRow("char in string") << QString("b") << QString("abc") << 1;
+    QTest::newRow("repeated chars") << QString("aaaa") << QString("aa") << 2;
+    QTest::newRow("repeated pattern") << QString("abababab") << QString("babba") << 3;
+    QTest::newRow("unrelated") << QString("abcd") << QString("efgh") << 0;
+    QTest::newRow("title") << QString("benchmark title 12 original")
+                           << QString("benchmark title 13") << 17;
+    // compared by UTF-16 code unit, like the rest of FuzzSearcher
+    QTest::newRow("surrogate pair") << QString::fromUtf8("x\xF0\x9F\x98\x80y")
+                                    << QString::fromUtf8("\xF0\x9F\x98\x80") << 2;
+    QTest::newRow("same high surrogate")
+        << QString::fromUtf8("\xF0\x9F\x98\x80") << QString::fromUtf8("\xF0\x9F\x98\x81")
+        << 1;
+}
+
+void TestMatching::longestCommonSubstring() {
+    QFETCH(QString, a);
+    QFETCH(QString, b);
+    QFETCH(int, expected);
+
+    QCOMPARE(FuzzSearcher::Lcs(a, b).size(), expected);
+    QCOMPARE(SubstringAutomaton{a}.longestCommonSubstring(b), expected);
+    QCOMPARE(SubstringAutomaton{b}.longestCommonSubstring(a), expected);
+}
+
+void TestMatching::postingListRoundTrip_data() {
+    QTest::addColumn<std::vector<int64_t>>("fids");
+
+    QTest::newRow("empty") << std::vector<int64_t>{};
+    QTest::newRow("zero") << std::vector<int64_t>{0};
+    QTest::newRow("dense") << std::vector<int64_t>{1, 2, 3, 4, 5, 6, 7, 8};
+    // deltas of 127, 128, 16383 and 16384: the longest one and two byte entries and the
+    // shortest two and three byte ones
+    QTest::newRow("varint limits") << std::vector<int64_t>{127, 255, 16638, 33022};
+    QTest::newRow("max") << std::vector<int64_t>{
+        1, std::numeric_limits<int64_t>::max() - 1, std::numeric_limits<int64_t>::max()};
+}
+
+void TestMatching::postingListRoundTrip() {
+    QFETCH(std::vector<int64_t>, fids);
+
+    QCOMPARE(PostingList::Decode(PostingList::Encode(fids)), fids);
+}
+
+void TestMatching::postingListCorruptBlob() {
+    QByteArray bytes = PostingList::Encode({3, 5});
+    // a truncated entry
+    QCOMPARE(PostingList::Decode(bytes + char(0x80)), (std::vector<int64_t>{3, 5}));
+    // more continuation bytes than a 64 bit delta has
+    QCOMPARE(PostingList::Decode(bytes + QByteArray(16, char(0xff)) + char(1)),
+             (std::vector<int64_t>{3, 5}));
+}
+
+QTEST_APPLESS_MAIN(TestMatching)
+
+#include "tst_matching.moc"
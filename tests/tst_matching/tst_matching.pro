@@ -0,0 +1,16 @@
+QT     += core concurrent testlib
+QT     -= gui
+CONFIG += c++17 testcase
+TARGET = tst_matching
+
+# the sources include both "data/..." and "src/..."
+INCLUDEPATH += ../../src/ ../../
+
+SOURCES += \
+    tst_matching.cpp \
+    ../../src/FuzzSearcher.cpp \
+    ../../src/data/PostingList.cpp
+
+HEADERS += \
+    ../../src/FuzzSearcher.h \
+    ../../src/data/PostingList.h
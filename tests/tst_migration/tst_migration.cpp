@@ -0,0 +1,62 @@
+#include <QTemporaryDir>
+#include <QtSql>
+#include <QtTest>
+
+#include "data/DataStore.h"
+#include "data/DatabaseSchema.h"
+
+// Upgrades databases written by older revisions of the schema.
+class TestMigration : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void init();
+    void cleanup();
+    void coverImagesKeepsCoverHashesTrigger();
+
+  private:
+    static constexpr const char *kConnectionName = "test-migration";
+    QTemporaryDir dir_;
+};
+
+void TestMigration::init() {
+    QVERIFY(dir_.isValid());
+    QVERIFY(DataStore::OpenDatabase(dir_.filePath("EhDbViewer.db"), kConnectionName));
+}
+
+void TestMigration::cleanup() {
+    QSqlDatabase::removeDatabase(kConnectionName);
+    QFile::remove(dir_.filePath("EhDbViewer.db"));
+}
+
+// cover_images 1 -> 2 rebuilds the table, the trigger of cover_hashes on it must survive.
+void TestMigration::coverImagesKeepsCoverHashesTrigger() {
+    QSqlDatabase db = QSqlDatabase::database(kConnectionName);
+    QSqlQuery query{db};
+    // a database from before cover_hashes existed
+    QVERIFY(query.exec(schema::TableRevision::CreationSql()));
+    QVERIFY(query.exec(schema::CoverImages::CreationSql()));
+    QVERIFY(query.exec("INSERT INTO table_revision VALUES ('cover_images', 1)"));
+    QVERIFY(query.exec("INSERT INTO cover_images VALUES (1, 'cover.jpg', '')"));
+
+    QVERIFY(DataStore::DbCreateTables(db));
+
+    QVERIFY(query.exec("SELECT revision FROM table_revision "
+                       "WHERE table_name = 'cover_images'"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toLongLong(), 2);
+    QVERIFY(query.exec("SELECT tbl_name FROM sqlite_master "
+                       "WHERE type = 'trigger' AND name = 'cover_hashes_cover_images_ad'"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toString(), QString("cover_images"));
+
+    // and still deletes the hash along with the cover
+    QVERIFY(query.exec("INSERT OR REPLACE INTO cover_hashes VALUES (1, 0, 0, 0, 0, 0)"));
+    QVERIFY(query.exec("DELETE FROM cover_images WHERE fid = 1"));
+    QVERIFY(query.exec("SELECT count(*) FROM cover_hashes WHERE fid = 1"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toLongLong(), 0);
+}
+
+QTEST_MAIN(TestMigration)
+#include "tst_migration.moc"
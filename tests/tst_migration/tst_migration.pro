@@ -0,0 +1,23 @@
+QT     += core gui widgets sql network concurrent testlib
+CONFIG += c++17 testcase
+TARGET = tst_migration
+
+# the sources include both "data/..." and "src/..."
+INCLUDEPATH += ../../src/ ../../
+
+SOURCES += \
+    tst_migration.cpp \
+    ../../src/data/DataStore.cpp \
+    ../../src/data/EhentaiApi.cpp \
+    ../../src/data/ImageHash.cpp \
+    ../../src/data/PostingList.cpp \
+    ../../src/data/SearchIndex.cpp \
+    ../../src/data/SearchTerm.cpp \
+    ../../src/DuplicateClusterer.cpp \
+    ../../src/FuzzSearcher.cpp
+
+HEADERS += \
+    ../../src/data/DataStore.h \
+    ../../src/data/DatabaseSchema.h \
+    ../../src/data/EhentaiApi.h \
+    ../../src/data/SearchIndex.h